@@ -1,15 +1,552 @@
 #include "renderer.h"
 
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+
 
 namespace steam { namespace py {
 
+using namespace boost::python;
+
+namespace {
+
+/* View on a python object implementing the buffer protocol (array.array,
+ * numpy arrays, bytearray...). Lets the addon pass geometry filled with
+ * foreach_get() without going through python lists. */
+class BufferView {
+  public:
+	BufferView(const object &obj, bool writable = false) {
+		int flags = writable ? PyBUF_WRITABLE : PyBUF_SIMPLE;
+		if (PyObject_GetBuffer(obj.ptr(), &view_, flags) != 0)
+			throw_error_already_set();
+	}
+
+	~BufferView() {
+		PyBuffer_Release(&view_);
+	}
+
+	template<typename T>
+	T *data() const { return (T *)view_.buf; }
+
+	size_t size() const { return (size_t)view_.len; }
+
+	/* Number of elements of num_components values of type T. */
+	template<typename T>
+	size_t count(size_t num_components, const char *what) const {
+		if (size() % (sizeof(T) * num_components) != 0)
+			throw std::invalid_argument(std::string(what) + ": buffer size does not match element size");
+		return size() / (sizeof(T) * num_components);
+	}
+
+  private:
+	Py_buffer view_;
+};
+
+/* Releases the GIL for the lifetime of the object. */
+class ScopedGILRelease {
+  public:
+	ScopedGILRelease(): state_(PyEval_SaveThread()) {}
+	~ScopedGILRelease() { PyEval_RestoreThread(state_); }
+
+  private:
+	PyThreadState *state_;
+};
+
+float3 to_float3(const object &seq) {
+	return make_float3(extract<float>(seq[0]), extract<float>(seq[1]), extract<float>(seq[2]));
+}
+
+Scene *get_scene(SteamRenderer &renderer) {
+	if (!renderer.is_initialized())
+		throw std::runtime_error("Renderer is not initialized, call init() first");
+	return renderer.scene();
+}
+
+void clear(SteamRenderer &renderer) {
+	get_scene(renderer)->clear();
+}
+
+/* Prototype BVHs survive clear() so the next frame can reuse them, drop them
+ * when the next sync will not add the same meshes. */
+void clear_geometry_cache(SteamRenderer &renderer) {
+	get_scene(renderer)->clear_geometry_cache();
+}
+
+/* color_texture: index returned by add_texture, multiplied with color on
+ * meshes with UVs. */
+int add_shader(SteamRenderer &renderer, const object &color, const object &emission, int color_texture) {
+	Scene *scene = get_scene(renderer);
+	if (color_texture >= (int)scene->textures.num_images())
+		throw std::out_of_range("add_shader: texture index out of range");
+	return scene->add_shader(Shader(to_float3(color), to_float3(emission), color_texture));
+}
+
+/* pixels: 8 bit or float32 values with channels per pixel, rows from the
+ * bottom like Image.pixels. The buffer is not copied, it stays referenced
+ * until the scene is cleared and tiles are read from it while rendering, so a
+ * numpy memmap of a large image only pages in what the render touches. srgb
+ * applies to 8 bit pixels, float pixels are linear. compression block
+ * compresses the cached tiles, COLOR for color textures, SCALAR for masks
+ * like roughness and NORMAL for normal maps. */
+int add_texture(SteamRenderer &renderer, const std::string &name, const object &pixels, int width, int height,
+                int channels, bool srgb, TextureCompression compression) {
+	Scene *scene = get_scene(renderer);
+
+	if (width <= 0 || height <= 0 || channels < 1 || channels > 4)
+		throw std::invalid_argument("add_texture: resolution must be positive and channels 1 to 4");
+
+	std::shared_ptr<BufferView> buffer = std::make_shared<BufferView>(pixels);
+	const size_t num_values = (size_t)width * height * channels;
+	bool is_float;
+	if (buffer->size() == num_values)
+		is_float = false;
+	else if (buffer->size() == num_values * sizeof(float))
+		is_float = true;
+	else
+		throw std::invalid_argument("add_texture: expected width * height * channels 8 bit or float values");
+
+	return scene->textures.add_image(name, new MemoryImageSource(buffer->data<void>(), width, height, channels, is_float,
+	                                                             srgb, buffer), compression);
+}
+
+/* Budget of the texture tile cache in bytes, tiles past it are evicted and
+ * read again when needed. */
+size_t get_texture_memory_limit(SteamRenderer &renderer) {
+	return get_scene(renderer)->textures.memory_limit();
+}
+
+void set_texture_memory_limit(SteamRenderer &renderer, size_t bytes) {
+	get_scene(renderer)->textures.set_memory_limit(bytes);
+}
+
+size_t get_texture_memory_used(SteamRenderer &renderer) {
+	return get_scene(renderer)->textures.memory_used();
+}
+
+/* Per triangle shader indices, per vertex normals and UVs per triangle
+ * corner, all optional. */
+void set_mesh_shading(Mesh *mesh, const object &shaders, const object &normals, const object &uvs) {
+	const size_t num_verts = mesh->num_vertices();
+	const size_t num_tris = mesh->num_triangles();
+
+	if (!shaders.is_none()) {
+		BufferView sbuf(shaders);
+		if (sbuf.count<int>(1, "shaders") != num_tris)
+			throw std::invalid_argument("add_mesh: expected one shader index per triangle");
+		mesh->shader.assign(sbuf.data<int>(), sbuf.data<int>() + num_tris);
+	}
+
+	if (!normals.is_none()) {
+		BufferView nbuf(normals);
+		if (nbuf.count<float>(3, "normals") != num_verts)
+			throw std::invalid_argument("add_mesh: expected one normal per vertex");
+		mesh->vertex_normals.assign(nbuf.data<float3>(), nbuf.data<float3>() + num_verts);
+		mesh->smooth = true;
+	}
+
+	if (!uvs.is_none()) {
+		BufferView ubuf(uvs);
+		if (ubuf.count<float>(2, "uvs") != num_tris * 3)
+			throw std::invalid_argument("add_mesh: expected one uv per triangle corner");
+		mesh->uvs.assign(ubuf.data<float2>(), ubuf.data<float2>() + num_tris * 3);
+	}
+}
+
+/* Positions of the other motion steps in time order, num_elements per step
+ * and the center step being the regular data. Returns the number of steps. */
+template<typename T>
+int get_motion_steps(const object &motion, size_t num_elements, std::vector<T> *data, const char *what) {
+	if (motion.is_none())
+		return 1;
+
+	BufferView mbuf(motion);
+	const size_t num = mbuf.count<float>(sizeof(T) / sizeof(float), what);
+	if (num_elements == 0 || num % num_elements != 0 || (num / num_elements) % 2 != 0)
+		throw std::invalid_argument(std::string(what) + ": expected an even number of motion steps");
+
+	data->assign(mbuf.data<T>(), mbuf.data<T>() + num);
+	return (int)(num / num_elements) + 1;
+}
+
+void check_triangles(const int3 *tris, size_t num_tris, size_t num_verts) {
+	for (size_t i = 0; i < num_tris; i++) {
+		const int3 &t = tris[i];
+		if (t.x < 0 || t.y < 0 || t.z < 0 || (size_t)t.x >= num_verts || (size_t)t.y >= num_verts || (size_t)t.z >= num_verts)
+			throw std::out_of_range("add_mesh: triangle vertex index out of range");
+	}
+}
+
+/* Curves need at least 2 keys, first keys are increasing and in range. */
+void check_curves(const int *first_key, size_t num_curves, size_t num_keys) {
+	for (size_t i = 0; i < num_curves; i++) {
+		const size_t end = (i + 1 < num_curves) ? (size_t)std::max(first_key[i + 1], 0) : num_keys;
+		if (first_key[i] < 0 || end > num_keys || (size_t)first_key[i] + 2 > end)
+			throw std::out_of_range("add_hair: curve key range out of order or too short");
+	}
+}
+
+/* Write the mesh to the geometry cache when enabled and the caller gave a key.
+ * Meshes the cache can not hold are skipped silently, like keys that already
+ * have a valid entry, which the caller just as well could have loaded. */
+void store_cached_mesh(SteamRenderer &renderer, const std::string &cache_key, const Mesh &mesh) {
+	if (cache_key.empty() || !renderer.geometry_cache.enabled() || !GeometryCache::supports(mesh))
+		return;
+
+	ScopedGILRelease gil;
+	if (renderer.geometry_cache.contains(cache_key))
+		return;
+	if (!renderer.geometry_cache.store(cache_key, mesh))
+		std::cerr << "Unable to write geometry cache entry for " << mesh.name << std::endl;
+}
+
+/* vertices: float32 xyz, triangles: int32 vertex indices, shaders: optional
+ * int32 per triangle, normals: optional float32 xyz per vertex. Returns the
+ * mesh index, which shares the data of an earlier mesh when the content is
+ * identical unless deduplicate is off. Pass deduplicate=False for meshes that
+ * will go through update_mesh_vertices(), merged meshes would all deform. With
+ * a cache_key the mesh is also written to the geometry cache, unless the key
+ * is cached already or the mesh has motion or uvs, which the cache does not
+ * hold. motion_vertices: optional float32 xyz of all vertices for each motion
+ * step before and after the shutter center, the vertices being the center.
+ * uvs: optional float32 uv per triangle corner for textured shaders. */
+int add_mesh(SteamRenderer &renderer, const std::string &name, const object &vertices, const object &triangles,
+             const object &shaders, const object &normals, const std::string &cache_key,
+             const object &motion_vertices, const object &uvs, bool deduplicate) {
+	Scene *scene = get_scene(renderer);
+
+	BufferView vbuf(vertices);
+	BufferView tbuf(triangles);
+	const size_t num_verts = vbuf.count<float>(3, "vertices");
+	const size_t num_tris = tbuf.count<int>(3, "triangles");
+	check_triangles(tbuf.data<int3>(), num_tris, num_verts);
+
+	std::unique_ptr<Mesh> mesh(new Mesh());
+	mesh->name = name;
+	mesh->verts.assign(vbuf.data<float3>(), vbuf.data<float3>() + num_verts);
+	mesh->triangles.assign(tbuf.data<int3>(), tbuf.data<int3>() + num_tris);
+	set_mesh_shading(mesh.get(), shaders, normals, uvs);
+	mesh->motion_steps = get_motion_steps(motion_vertices, num_verts, &mesh->motion_verts, "motion_vertices");
+
+	store_cached_mesh(renderer, cache_key, *mesh);
+	return scene->add_mesh(mesh.release(), deduplicate);
+}
+
+/* keys: float32 xyz plus radius per key, curves: int32 first key per curve,
+ * shaders: optional int32 per curve. Hair is added as a mesh without
+ * triangles, instancing and deduplication work the same as for meshes.
+ * motion_keys: optional keys for the other motion steps, like add_mesh. */
+int add_hair(SteamRenderer &renderer, const std::string &name, const object &keys, const object &curves,
+             const object &shaders, CurveShape shape, const object &motion_keys) {
+	Scene *scene = get_scene(renderer);
+
+	BufferView kbuf(keys);
+	BufferView cbuf(curves);
+	const size_t num_keys = kbuf.count<float>(4, "keys");
+	const size_t num_curves = cbuf.count<int>(1, "curves");
+	check_curves(cbuf.data<int>(), num_curves, num_keys);
+
+	std::unique_ptr<Mesh> mesh(new Mesh());
+	mesh->name = name;
+	mesh->curve_shape = shape;
+	mesh->curve_keys.assign(kbuf.data<float4>(), kbuf.data<float4>() + num_keys);
+	mesh->curve_first_key.assign(cbuf.data<int>(), cbuf.data<int>() + num_curves);
+
+	if (!shaders.is_none()) {
+		BufferView sbuf(shaders);
+		if (sbuf.count<int>(1, "shaders") != num_curves)
+			throw std::invalid_argument("add_hair: expected one shader index per curve");
+		mesh->curve_shader.assign(sbuf.data<int>(), sbuf.data<int>() + num_curves);
+	}
+	else {
+		mesh->curve_shader.assign(num_curves, 0);
+	}
+
+	mesh->motion_steps = get_motion_steps(motion_keys, num_keys, &mesh->motion_curve_keys, "motion_keys");
+
+	return scene->add_mesh(mesh.release());
+}
+
+/* Buffers exported by python objects and referenced by a mesh. */
+struct SharedMeshBuffers {
+	SharedMeshBuffers(const object &vertices, const object &triangles): vertices(vertices), triangles(triangles) {}
+
+	BufferView vertices;
+	BufferView triangles;
+};
+
+/* Like add_mesh, but Embree reads vertices and triangles straight from the
+ * python buffers, which stay referenced until the scene is cleared. With a
+ * vertex_stride of 20 the vertex buffer can wrap Blender's MVert array
+ * directly, e.g. through ctypes on mesh.vertices[0].as_pointer(). */
+int add_mesh_shared(SteamRenderer &renderer, const std::string &name, const object &vertices, int vertex_stride,
+                    const object &triangles, const object &shaders, const object &normals,
+                    const std::string &cache_key, const object &motion_vertices, const object &uvs) {
+	Scene *scene = get_scene(renderer);
+
+	if (vertex_stride < (int)sizeof(float3) || vertex_stride % 4 != 0)
+		throw std::invalid_argument("add_mesh_shared: vertex_stride must be a multiple of 4 and at least 12");
+
+	std::shared_ptr<SharedMeshBuffers> buffers = std::make_shared<SharedMeshBuffers>(vertices, triangles);
+	const size_t num_verts = buffers->vertices.size() / vertex_stride;
+	const size_t num_tris = buffers->triangles.count<int>(3, "triangles");
+	check_triangles(buffers->triangles.data<int3>(), num_tris, num_verts);
+
+	std::unique_ptr<Mesh> mesh(new Mesh());
+	mesh->name = name;
+	mesh->set_shared_vertices(buffers->vertices.data<void>(), vertex_stride, num_verts, false);
+	mesh->set_shared_triangles(buffers->triangles.data<int>(), num_tris);
+	mesh->shared_owner = buffers;
+	set_mesh_shading(mesh.get(), shaders, normals, uvs);
+	mesh->motion_steps = get_motion_steps(motion_vertices, num_verts, &mesh->motion_verts, "motion_vertices");
+
+	store_cached_mesh(renderer, cache_key, *mesh);
+	return scene->add_mesh(mesh.release());
+}
+
+/* Add a mesh written by an earlier add_mesh with the same cache_key, skipping
+ * the export from Blender. Returns -1 when it is not cached. */
+int add_cached_mesh(SteamRenderer &renderer, const std::string &name, const std::string &cache_key) {
+	Scene *scene = get_scene(renderer);
+
+	Mesh *mesh;
+	{
+		ScopedGILRelease gil;
+		mesh = renderer.geometry_cache.load(cache_key);
+	}
+	if (!mesh)
+		return -1;
+
+	mesh->name = name;
+	return scene->add_mesh(mesh);
+}
+
+std::string get_geometry_cache_dir(SteamRenderer &renderer) {
+	return renderer.geometry_cache.directory();
+}
+
+void set_geometry_cache_dir(SteamRenderer &renderer, const std::string &directory) {
+	renderer.geometry_cache.set_directory(directory);
+}
+
+void add_light(SteamRenderer &renderer, int type, const object &co, const object &dir, const object &strength) {
+	Light light;
+	light.type = (type == LIGHT_SUN) ? LIGHT_SUN : LIGHT_POINT;
+	light.co = to_float3(co);
+	light.dir = to_float3(dir);
+	light.strength = to_float3(strength);
+	get_scene(renderer)->add_light(light);
+}
+
+/* density: float32 voxels with x varying fastest, resolution: (width, height,
+ * depth), matrix: row major 4x4 object to world matrix, the grid fills the
+ * unit cube of object space. Bricks of voxels within tolerance of the
+ * background are not stored. */
+int add_volume(SteamRenderer &renderer, const std::string &name, const object &density, const object &resolution,
+               const object &matrix, const object &albedo, float density_scale, float background, float tolerance) {
+	Scene *scene = get_scene(renderer);
+
+	const int width = extract<int>(resolution[0]);
+	const int height = extract<int>(resolution[1]);
+	const int depth = extract<int>(resolution[2]);
+	if (width <= 0 || height <= 0 || depth <= 0)
+		throw std::invalid_argument("add_volume: resolution must be positive");
+
+	BufferView dbuf(density);
+	if (dbuf.count<float>(1, "density") != (size_t)width * height * depth)
+		throw std::invalid_argument("add_volume: expected width * height * depth density values");
+
+	float m[16];
+	for (int i = 0; i < 16; i++)
+		m[i] = extract<float>(matrix[i]);
+
+	std::unique_ptr<Volume> volume(new Volume());
+	volume->name = name;
+	volume->tfm = transform_from_matrix(m);
+	volume->albedo = to_float3(albedo);
+	volume->density_scale = density_scale;
+
+	{
+		ScopedGILRelease gil;
+		volume->density.build(dbuf.data<float>(), width, height, depth, background, tolerance);
+	}
+
+	if (!volume->update_transform())
+		throw std::invalid_argument("add_volume: matrix is not invertible");
+
+	return scene->add_volume(volume.release());
+}
+
+void set_background(SteamRenderer &renderer, const object &color) {
+	get_scene(renderer)->background = to_float3(color);
+}
+
+/* matrix: 16 floats of the row major camera to world matrix, fov: horizontal angle. */
+void set_camera(SteamRenderer &renderer, const object &matrix, float fov) {
+	float m[16];
+	for (int i = 0; i < 16; i++)
+		m[i] = extract<float>(matrix[i]);
+
+	Camera &camera = get_scene(renderer)->camera;
+	camera.matrix = transform_from_matrix(m);
+	camera.fov = fov;
+}
+
+/* matrices: float32, one row major 4x4 object to world matrix per instance.
+ * With motion_steps above 1, that many matrices per instance in time order
+ * over the shutter. */
+void add_instances(SteamRenderer &renderer, int mesh, const object &matrices, int motion_steps) {
+	Scene *scene = get_scene(renderer);
+	if (mesh < 0 || mesh >= (int)scene->meshes.size())
+		throw std::out_of_range("add_instances: mesh index out of range");
+	if (motion_steps < 1)
+		throw std::invalid_argument("add_instances: motion_steps must be at least 1");
+
+	BufferView mbuf(matrices);
+	const size_t num_matrices = mbuf.count<float>(16, "matrices");
+	if (num_matrices % motion_steps != 0)
+		throw std::invalid_argument("add_instances: expected motion_steps matrices per instance");
+
+	const size_t num_instances = num_matrices / motion_steps;
+	const float *m = mbuf.data<float>();
+
+	scene->instance_mesh.reserve(scene->instance_mesh.size() + num_instances);
+	scene->instance_tfm.reserve(scene->instance_tfm.size() + num_instances);
+	scene->instance_motion.reserve(scene->instance_motion.size() + num_instances);
+
+	if (motion_steps == 1) {
+		for (size_t i = 0; i < num_instances; i++)
+			scene->add_instance(mesh, transform_from_matrix(m + i * 16));
+		return;
+	}
+
+	std::vector<Transform> motion(motion_steps);
+	for (size_t i = 0; i < num_instances; i++) {
+		for (int step = 0; step < motion_steps; step++)
+			motion[step] = transform_from_matrix(m + (i * motion_steps + step) * 16);
+		scene->add_instance(mesh, motion);
+	}
+}
+
+/* Move existing instances [start, start + count), cheaper than clearing and
+ * adding the scene again as the next render only refits. */
+void set_instance_transforms(SteamRenderer &renderer, int start, const object &matrices) {
+	Scene *scene = get_scene(renderer);
+
+	BufferView mbuf(matrices);
+	const size_t num_instances = mbuf.count<float>(16, "matrices");
+	if (start < 0 || start + num_instances > scene->instance_tfm.size())
+		throw std::out_of_range("set_instance_transforms: instance range out of range");
+
+	const float *m = mbuf.data<float>();
+	for (size_t i = 0; i < num_instances; i++)
+		scene->set_instance_transform(start + i, transform_from_matrix(m + i * 16));
+}
+
+/* New positions for a mesh with unchanged topology. Without vertices, a
+ * shared vertex buffer was modified in place by the caller. */
+void update_mesh_vertices(SteamRenderer &renderer, int mesh_index, const object &vertices) {
+	Scene *scene = get_scene(renderer);
+	if (mesh_index < 0 || mesh_index >= (int)scene->meshes.size())
+		throw std::out_of_range("update_mesh_vertices: mesh index out of range");
+
+	Mesh *mesh = scene->meshes[mesh_index];
+
+	if (!vertices.is_none()) {
+		if (mesh->verts.size() != mesh->num_vertices())
+			throw std::invalid_argument("update_mesh_vertices: mesh uses a shared vertex buffer");
+
+		BufferView vbuf(vertices);
+		if (vbuf.count<float>(3, "vertices") != mesh->verts.size())
+			throw std::invalid_argument("update_mesh_vertices: vertex count changed");
+		std::copy(vbuf.data<float3>(), vbuf.data<float3>() + mesh->verts.size(), mesh->verts.begin());
+	}
+
+	scene->tag_mesh_deformed(mesh_index);
+}
+
+bool get_dynamic_scene(SteamRenderer &renderer) {
+	return get_scene(renderer)->is_dynamic();
+}
+
+void set_dynamic_scene(SteamRenderer &renderer, bool dynamic) {
+	get_scene(renderer)->set_dynamic(dynamic);
+}
+
+void render(SteamRenderer &renderer, int width, int height, int samples) {
+	get_scene(renderer);
+	renderer.set_resolution(width, height);
+
+	ScopedGILRelease gil;
+	renderer.render(samples);
+}
+
+void get_pixels(SteamRenderer &renderer, const object &buffer) {
+	BufferView view(buffer, true);
+	if (view.size() < (size_t)renderer.width() * renderer.height() * 4 * sizeof(float))
+		throw std::invalid_argument("get_pixels: buffer is smaller than width * height * 4 floats");
+
+	renderer.get_pixels(view.data<float>());
+}
+
+} // namespace
+
 
 void export_Renderer() {
-	//boost::python::class_<SteamRenderer, boost::noncopyable>("Renderer")
-		//.def("init", &SteamRenderer::init)
-		//.def("textureManager", &SteamRenderer::textureManager,
-		//	boost::python::return_value_policy<boost::python::reference_existing_object>())
-		//;
+	boost::python::enum_<IntegratorMode>("IntegratorMode")
+		.value("SINGLE_RAY", INTEGRATOR_SINGLE_RAY)
+		.value("RAY_STREAM", INTEGRATOR_RAY_STREAM)
+		;
+
+	boost::python::enum_<CurveShape>("CurveShape")
+		.value("RIBBON", CURVE_RIBBON)
+		.value("THICK", CURVE_THICK)
+		;
+
+	boost::python::enum_<TextureCompression>("TextureCompression")
+		.value("NONE", TEXTURE_COMPRESSION_NONE)
+		.value("COLOR", TEXTURE_COMPRESSION_COLOR)
+		.value("SCALAR", TEXTURE_COMPRESSION_SCALAR)
+		.value("NORMAL", TEXTURE_COMPRESSION_NORMAL)
+		;
+
+	boost::python::class_<IntegratorParams>("IntegratorParams")
+		.def_readwrite("mode", &IntegratorParams::mode)
+		.def_readwrite("max_bounces", &IntegratorParams::max_bounces)
+		.def_readwrite("seed", &IntegratorParams::seed)
+		.def_readwrite("transparent_background", &IntegratorParams::transparent_background)
+		;
+
+	boost::python::class_<SteamRenderer, boost::noncopyable>("Renderer")
+		.def("init", &SteamRenderer::init, (arg("threads") = 0))
+		.def("clear", &clear)
+		.def("clear_geometry_cache", &clear_geometry_cache)
+		.def("add_shader", &add_shader, (arg("color"), arg("emission"), arg("color_texture") = -1))
+		.def("add_texture", &add_texture, (arg("name"), arg("pixels"), arg("width"), arg("height"), arg("channels") = 4, arg("srgb") = true, arg("compression") = TEXTURE_COMPRESSION_NONE))
+		.def("add_mesh", &add_mesh, (arg("name"), arg("vertices"), arg("triangles"), arg("shaders") = object(), arg("normals") = object(), arg("cache_key") = std::string(), arg("motion_vertices") = object(), arg("uvs") = object(), arg("deduplicate") = true))
+		.def("add_mesh_shared", &add_mesh_shared, (arg("name"), arg("vertices"), arg("vertex_stride"), arg("triangles"), arg("shaders") = object(), arg("normals") = object(), arg("cache_key") = std::string(), arg("motion_vertices") = object(), arg("uvs") = object()))
+		.def("add_cached_mesh", &add_cached_mesh, (arg("name"), arg("cache_key")))
+		.def("add_hair", &add_hair, (arg("name"), arg("keys"), arg("curves"), arg("shaders") = object(), arg("shape") = CURVE_THICK, arg("motion_keys") = object()))
+		.def("add_instances", &add_instances, (arg("mesh"), arg("matrices"), arg("motion_steps") = 1))
+		.def("set_instance_transforms", &set_instance_transforms, (arg("start"), arg("matrices")))
+		.def("update_mesh_vertices", &update_mesh_vertices, (arg("mesh"), arg("vertices") = object()))
+		.def("add_light", &add_light)
+		.def("add_volume", &add_volume, (arg("name"), arg("density"), arg("resolution"), arg("matrix"), arg("albedo"), arg("density_scale") = 1.0f, arg("background") = 0.0f, arg("tolerance") = 0.0f))
+		.def("set_background", &set_background)
+		.def("set_camera", &set_camera)
+		.def("render", &render)
+		.def("cancel", &SteamRenderer::cancel)
+		.def("progress", &SteamRenderer::progress)
+		.def("get_pixels", &get_pixels)
+		.add_property("width", &SteamRenderer::width)
+		.add_property("height", &SteamRenderer::height)
+		.add_property("threads", &SteamRenderer::num_threads)
+		.add_property("dynamic_scene", &get_dynamic_scene, &set_dynamic_scene)
+		.add_property("geometry_cache_dir", &get_geometry_cache_dir, &set_geometry_cache_dir)
+		.add_property("texture_memory_limit", &get_texture_memory_limit, &set_texture_memory_limit)
+		.add_property("texture_memory_used", &get_texture_memory_used)
+		.add_property("params", make_getter(&SteamRenderer::params, return_internal_reference<>()), make_setter(&SteamRenderer::params))
+		;
 }
 
-}} // namespace
\ No newline at end of file
+}} // namespace
@@ -5,7 +5,7 @@
 #include <boost/shared_ptr.hpp>
 #include <boost/python/extract.hpp>
 
-//#include "fasta_lib/renderer.h"
+#include "steam_lib/renderer.h"
 
 
 namespace steam { namespace py {
@@ -17,4 +17,4 @@ void export_Renderer();
 
 }}
 
-#endif //__FASTA_PY_RENDERER_H__
\ No newline at end of file
+#endif //__FASTA_PY_RENDERER_H__
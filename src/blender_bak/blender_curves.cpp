@@ -29,6 +29,8 @@
 #include "util/util_hash.h"
 #include "util/util_logging.h"
 
+#include "BKE_particle.h"
+
 CCL_NAMESPACE_BEGIN
 
 ParticleCurveData::ParticleCurveData()
@@ -595,82 +597,189 @@ static void ExportCurveTriangleGeometry(Mesh *mesh, ParticleCurveData *CData, in
   /* texture coords still needed */
 }
 
-static void ExportCurveSegments(Scene *scene, Hair *hair, ParticleCurveData *CData)
+/* Particle system exported straight from its path caches into the hair buffers. */
+struct ParticleHairSystem {
+  const ParticleSystem *psys;
+  /* Particle space to object space. */
+  Transform tfm;
+  int first_particle;
+  int num_curves;
+  int ren_step;
+  int first_curve;
+  int first_key;
+  int shader;
+  float root_radius;
+  float tip_radius;
+  float shape;
+  bool close_tip;
+};
+
+/* Key location in particle space, as ParticleSystem.co_hair() reads it before transforming to
+ * world space. Returns false for keys the caches don't have. */
+static bool particle_hair_key_co(const ParticleSystem *psys, int pa_no, int step, float3 *co)
 {
-  int num_keys = 0;
-  int num_curves = 0;
+  /* Disconnected or global hair has no child cache. */
+  const int totpart = psys->totcached;
+  const int totchild = (psys->childcache) ? psys->totchildcache : 0;
+  const ParticleCacheKey *cache = NULL;
+
+  if (psys->particles == NULL) {
+    return false;
+  }
+
+  if (pa_no < totpart) {
+    if (psys->pathcache == NULL) {
+      return false;
+    }
+    cache = psys->pathcache[pa_no];
+  }
+  else if (pa_no < totpart + totchild) {
+    cache = psys->childcache[pa_no - totpart];
+  }
+  else {
+    return false;
+  }
 
+  if (step < 0 || step > max(cache->segments, 0)) {
+    return false;
+  }
+
+  const float *key_co = cache[step].co;
+  *co = make_float3(key_co[0], key_co[1], key_co[2]);
+  return true;
+}
+
+static void ExportParticleHairCurves(Scene *scene, Hair *hair, BL::Object &b_ob, bool background)
+{
   if (hair->num_curves())
     return;
 
-  Attribute *attr_intercept = NULL;
-  Attribute *attr_random = NULL;
+  const Transform tfm = get_transform(b_ob.matrix_world());
+  const Transform itfm = transform_quick_inverse(tfm);
 
-  if (hair->need_attribute(scene, ATTR_STD_CURVE_INTERCEPT))
-    attr_intercept = hair->attributes.add(ATTR_STD_CURVE_INTERCEPT);
-  if (hair->need_attribute(scene, ATTR_STD_CURVE_RANDOM))
-    attr_random = hair->attributes.add(ATTR_STD_CURVE_RANDOM);
+  /* Find the curve and key ranges of all systems up front, so the buffers are allocated once and
+   * every curve can be written independently. */
+  vector<ParticleHairSystem> systems;
+  int num_curves = 0;
+  int num_keys = 0;
 
-  /* compute and reserve size of arrays */
-  for (int sys = 0; sys < CData->psys_firstcurve.size(); sys++) {
-    for (int curve = CData->psys_firstcurve[sys];
-         curve < CData->psys_firstcurve[sys] + CData->psys_curvenum[sys];
-         curve++) {
-      num_keys += CData->curve_keynum[curve];
-      num_curves++;
-    }
-  }
+  BL::Object::modifiers_iterator b_mod;
+  for (b_ob.modifiers.begin(b_mod); b_mod != b_ob.modifiers.end(); ++b_mod) {
+    if ((b_mod->type() == b_mod->type_PARTICLE_SYSTEM) &&
+        (background ? b_mod->show_render() : b_mod->show_viewport())) {
+      BL::ParticleSystemModifier psmd((const PointerRNA)b_mod->ptr);
+      BL::ParticleSystem b_psys((const PointerRNA)psmd.particle_system().ptr);
+      BL::ParticleSettings b_part((const PointerRNA)b_psys.settings().ptr);
 
-  if (num_curves > 0) {
-    VLOG(1) << "Exporting curve segments for mesh " << hair->name;
-  }
+      if ((b_part.render_type() == BL::ParticleSettings::render_type_PATH) &&
+          (b_part.type() == BL::ParticleSettings::type_HAIR)) {
+        int display_step = background ? b_part.render_step() : b_part.display_step();
+        int totparts = b_psys.particles.length();
+        int totchild = background ? b_psys.child_particles.length() :
+                                    (int)((float)b_psys.child_particles.length() *
+                                          (float)b_part.display_percentage() / 100.0f);
 
-  hair->reserve_curves(hair->num_curves() + num_curves, hair->curve_keys.size() + num_keys);
+        int pa_no = 0;
+        if (!(b_part.child_type() == 0) && totchild != 0)
+          pa_no = totparts;
 
-  num_keys = 0;
-  num_curves = 0;
+        if (totparts + totchild - pa_no == 0)
+          continue;
 
-  /* actually export */
-  for (int sys = 0; sys < CData->psys_firstcurve.size(); sys++) {
-    for (int curve = CData->psys_firstcurve[sys];
-         curve < CData->psys_firstcurve[sys] + CData->psys_curvenum[sys];
-         curve++) {
-      size_t num_curve_keys = 0;
+        ParticleHairSystem sys;
+        sys.psys = (const ParticleSystem *)b_psys.ptr.data;
 
-      for (int curvekey = CData->curve_firstkey[curve];
-           curvekey < CData->curve_firstkey[curve] + CData->curve_keynum[curve];
-           curvekey++) {
-        const float3 ickey_loc = CData->curvekey_co[curvekey];
-        const float curve_time = CData->curvekey_time[curvekey];
-        const float curve_length = CData->curve_length[curve];
-        const float time = (curve_length > 0.0f) ? curve_time / curve_length : 0.0f;
-        float radius = shaperadius(
-            CData->psys_shape[sys], CData->psys_rootradius[sys], CData->psys_tipradius[sys], time);
-        if (CData->psys_closetip[sys] &&
-            (curvekey == CData->curve_firstkey[curve] + CData->curve_keynum[curve] - 1)) {
-          radius = 0.0f;
-        }
-        hair->add_curve_key(ickey_loc, radius);
-        if (attr_intercept)
-          attr_intercept->add(time);
+        /* Skip the round trip through world space that co_hair() makes. */
+        ProjectionTransform imat;
+        memcpy((void *)&imat, sys.psys->imat, sizeof(float) * 16);
+        sys.tfm = projection_to_transform(projection_transpose(imat));
 
-        num_curve_keys++;
-      }
+        sys.first_particle = pa_no;
+        sys.num_curves = totparts + totchild - pa_no;
+        sys.ren_step = (1 << display_step) + 1;
+        if (b_part.kink() == BL::ParticleSettings::kink_SPIRAL)
+          sys.ren_step += b_part.kink_extra_steps();
 
-      if (attr_random != NULL) {
-        attr_random->add(hash_uint2_to_float(num_curves, 0));
-      }
+        sys.first_curve = num_curves;
+        sys.first_key = num_keys;
+        sys.shader = clamp(b_part.material() - 1, 0, hair->used_shaders.size() - 1);
 
-      hair->add_curve(num_keys, CData->psys_shader[sys]);
-      num_keys += num_curve_keys;
-      num_curves++;
+        float radius = b_part.radius_scale() * 0.5f;
+        sys.root_radius = radius * b_part.root_radius();
+        sys.tip_radius = radius * b_part.tip_radius();
+        sys.shape = b_part.shape();
+        sys.close_tip = b_part.use_close_tip();
+
+        num_curves += sys.num_curves;
+        num_keys += sys.num_curves * sys.ren_step;
+        systems.push_back(sys);
+      }
     }
   }
 
-  /* check allocation */
-  if ((hair->curve_keys.size() != num_keys) || (hair->num_curves() != num_curves)) {
-    VLOG(1) << "Allocation failed, clearing data";
-    hair->clear();
+  if (num_curves == 0)
+    return;
+
+  VLOG(1) << "Exporting curve segments for mesh " << hair->name;
+
+  hair->resize_curves(num_curves, num_keys);
+
+  Attribute *attr_intercept = NULL;
+  Attribute *attr_random = NULL;
+
+  if (hair->need_attribute(scene, ATTR_STD_CURVE_INTERCEPT))
+    attr_intercept = hair->attributes.add(ATTR_STD_CURVE_INTERCEPT);
+  if (hair->need_attribute(scene, ATTR_STD_CURVE_RANDOM))
+    attr_random = hair->attributes.add(ATTR_STD_CURVE_RANDOM);
+
+  float3 *keys = hair->curve_keys.data();
+  float *radius = hair->curve_radius.data();
+  int *curve_first_key = hair->curve_first_key.data();
+  int *curve_shader = hair->curve_shader.data();
+  float *intercept = (attr_intercept) ? attr_intercept->data_float() : NULL;
+  float *random = (attr_random) ? attr_random->data_float() : NULL;
+
+  /* Keys missing from the caches stay at the previous key, or the world origin. */
+  const float3 origin = transform_point(&itfm, make_float3(0.0f, 0.0f, 0.0f));
+
+  foreach (const ParticleHairSystem &sys, systems) {
+    parallel_for_range(sys.num_curves, [&](int start, int end) {
+      for (int i = start; i < end; i++) {
+        const int curve = sys.first_curve + i;
+        const int first_key = sys.first_key + i * sys.ren_step;
+        const int pa_no = sys.first_particle + i;
+
+        curve_first_key[curve] = first_key;
+        curve_shader[curve] = sys.shader;
+        if (random)
+          random[curve] = hash_uint2_to_float(curve, 0);
+
+        /* Locations, with the length up to each key kept in the radius for now. */
+        float3 co = origin;
+        float curve_length = 0.0f;
+
+        for (int step = 0; step < sys.ren_step; step++) {
+          float3 key_co;
+          if (particle_hair_key_co(sys.psys, pa_no, step, &key_co))
+            co = transform_point(&sys.tfm, key_co);
+          if (step > 0)
+            curve_length += len(co - keys[first_key + step - 1]);
+
+          keys[first_key + step] = co;
+          radius[first_key + step] = curve_length;
+        }
+
+        for (int key = first_key; key < first_key + sys.ren_step; key++) {
+          const float time = (curve_length > 0.0f) ? radius[key] / curve_length : 0.0f;
+          radius[key] = shaperadius(sys.shape, sys.root_radius, sys.tip_radius, time);
+          if (intercept)
+            intercept[key] = time;
+        }
+
+        if (sys.close_tip)
+          radius[first_key + sys.ren_step - 1] = 0.0f;
+      }
+    });
   }
 }
 
@@ -914,19 +1023,14 @@ void BlenderSync::sync_curve_settings()
   curve_system_manager->subdivisions = get_int(csscene, "subdivisions");
   curve_system_manager->use_backfacing = !get_boolean(csscene, "cull_backfacing");
 
-  /* Triangles */
+  /* Triangles multiply memory by the resolution over the curve keys, hair is always exported as
+   * curves now and traced with Embree's ribbon and round curve primitives. */
   if (curve_system_manager->primitive == CURVE_TRIANGLES) {
-    /* camera facing planes */
-    if (curve_system_manager->curve_shape == CURVE_RIBBON) {
-      curve_system_manager->triangle_method = CURVE_CAMERA_TRIANGLES;
-      curve_system_manager->resolution = 1;
-    }
-    else if (curve_system_manager->curve_shape == CURVE_THICK) {
-      curve_system_manager->triangle_method = CURVE_TESSELATED_TRIANGLES;
-    }
+    curve_system_manager->primitive = CURVE_SEGMENTS;
   }
+
   /* Line Segments */
-  else if (curve_system_manager->primitive == CURVE_LINE_SEGMENTS) {
+  if (curve_system_manager->primitive == CURVE_LINE_SEGMENTS) {
     if (curve_system_manager->curve_shape == CURVE_RIBBON) {
       /* tangent shading */
       curve_system_manager->line_method = CURVE_UNCORRECTED;
@@ -1012,7 +1116,14 @@ void BlenderSync::sync_particle_hair(
 
   ParticleCurveData CData;
 
-  ObtainCacheParticleData(geom, &b_mesh, &b_ob, &CData, !preview);
+  /* Static hair goes straight from the particle caches into the curve buffers, triangles and
+   * motion steps still go through the staging data. */
+  if (hair && !motion) {
+    ExportParticleHairCurves(scene, hair, b_ob, !preview);
+  }
+  else {
+    ObtainCacheParticleData(geom, &b_mesh, &b_ob, &CData, !preview);
+  }
 
   /* add hair geometry to mesh */
   if (mesh) {
@@ -1037,11 +1148,8 @@ void BlenderSync::sync_particle_hair(
       used_res = resolution;
     }
   }
-  else {
-    if (motion)
-      ExportCurveSegmentsMotion(hair, &CData, motion_step);
-    else
-      ExportCurveSegments(scene, hair, &CData);
+  else if (motion) {
+    ExportCurveSegmentsMotion(hair, &CData, motion_step);
   }
 
   /* generated coordinates from first key. we should ideally get this from
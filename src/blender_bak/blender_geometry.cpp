@@ -24,6 +24,7 @@
 #include "blender/blender_util.h"
 
 #include "util/util_foreach.h"
+#include "util/util_task.h"
 
 CCL_NAMESPACE_BEGIN
 
@@ -76,6 +77,7 @@ Geometry *BlenderSync::sync_geometry(BL::Depsgraph &b_depsgraph,
   /* Test if we need to sync. */
   Geometry *geom = geometry_map.find(key);
   bool sync = true;
+  bool attributes_only = false;
   if (geom == NULL) {
     /* Add new geometry if it did not exist yet. */
     if (geom_type == Geometry::HAIR) {
@@ -115,6 +117,10 @@ Geometry *BlenderSync::sync_geometry(BL::Depsgraph &b_depsgraph,
       if (!attribute_recalc) {
         return geom;
       }
+
+      /* Only the attributes requested by shaders changed, try to compute
+       * just the new ones instead of rebuilding the mesh. */
+      attributes_only = (geom->type == Geometry::MESH) && (geom_type == Geometry::MESH);
     }
   }
 
@@ -123,29 +129,84 @@ Geometry *BlenderSync::sync_geometry(BL::Depsgraph &b_depsgraph,
     return geom;
   }
 
-  progress.set_sync_status("Synchronizing object", b_ob.name());
-
   geometry_synced.insert(geom);
 
   geom->name = ustring(b_ob_data.name().c_str());
 
+  /* Tag here already, object sync checks it before the geometry is converted. */
+  geom->need_update = true;
+
+  /* Defer the actual conversion, it only writes to this geometry and runs in
+   * parallel with other geometry once all objects are synced. For duplis b_ob
+   * is a temporary the depsgraph iterator reuses on every step, so capture the
+   * evaluated object being instanced instead, which stays valid until the
+   * queue is flushed and shares the same evaluated data. */
+  BL::Depsgraph b_depsgraph_copy = b_depsgraph;
+  BL::Object b_ob_copy = b_ob_instance;
+  geometry_sync_queue.push_back([=]() mutable {
+    if (progress.get_cancel()) {
+      return;
+    }
+
+    progress.set_sync_status("Synchronizing object", b_ob_copy.name());
+
 #ifdef WITH_NEW_OBJECT_TYPES
-  if (b_ob.type() == BL::Object::type_HAIR || use_particle_hair) {
+    if (b_ob_copy.type() == BL::Object::type_HAIR || use_particle_hair) {
 #else
-  if (use_particle_hair) {
+    if (use_particle_hair) {
 #endif
-    sync_hair(b_depsgraph, b_ob, geom, used_shaders);
-  }
-  else if (b_ob.type() == BL::Object::type_VOLUME || object_fluid_gas_domain_find(b_ob)) {
-    Mesh *mesh = static_cast<Mesh *>(geom);
-    sync_volume(b_ob, mesh, used_shaders);
+      sync_hair(b_depsgraph_copy, b_ob_copy, geom, used_shaders);
+    }
+    else if (b_ob_copy.type() == BL::Object::type_VOLUME ||
+             object_fluid_gas_domain_find(b_ob_copy)) {
+      Mesh *mesh = static_cast<Mesh *>(geom);
+      sync_volume(b_ob_copy, mesh, used_shaders);
+    }
+    else {
+      Mesh *mesh = static_cast<Mesh *>(geom);
+      if (!attributes_only || !sync_mesh_attributes(b_depsgraph_copy, b_ob_copy, mesh)) {
+        sync_mesh(b_depsgraph_copy, b_ob_copy, mesh, used_shaders);
+      }
+    }
+  });
+
+  return geom;
+}
+
+void BlenderSync::sync_geometry_queue()
+{
+  TaskPool pool;
+
+  foreach (const TaskRunFunction &task, geometry_sync_queue) {
+    pool.push(task);
   }
-  else {
-    Mesh *mesh = static_cast<Mesh *>(geom);
-    sync_mesh(b_depsgraph, b_ob, mesh, used_shaders);
+
+  pool.wait_work();
+  geometry_sync_queue.clear();
+}
+
+void BlenderSync::sync_geometry_motion_queue()
+{
+  /* Finish the previous step first, it used the other snapshot which gets
+   * filled next and wrote to the same geometry this step writes to. */
+  motion_sync_pool.wait_work();
+
+  const MotionSnapshot &snapshot = motion_snapshots[motion_snapshot_index];
+  foreach (const MeshMotionStep &step, snapshot.meshes) {
+    motion_sync_pool.push([this, &snapshot, &step]() { sync_mesh_motion_step(snapshot, step); });
   }
 
-  return geom;
+  /* Writing the geometry now overlaps with evaluating the next frame. */
+  motion_snapshot_index ^= 1;
+  motion_snapshots[motion_snapshot_index].clear();
+}
+
+void BlenderSync::sync_geometry_motion_wait()
+{
+  motion_sync_pool.wait_work();
+  motion_snapshots[0].clear();
+  motion_snapshots[1].clear();
+  motion_snapshot_index = 0;
 }
 
 void BlenderSync::sync_geometry_motion(BL::Depsgraph &b_depsgraph,
@@ -19,20 +19,96 @@
 
 #include <string.h>
 
+#include "util/util_hash.h"
 #include "util/util_map.h"
-#include "util/util_set.h"
+#include "util/util_types.h"
 #include "util/util_vector.h"
 
 CCL_NAMESPACE_BEGIN
 
+inline uint id_map_hash(const void *ptr)
+{
+  const uint64_t value = (uint64_t)(uintptr_t)ptr;
+  return hash_uint2((uint)value, (uint)(value >> 32));
+}
+
+/* ID Map Index
+ *
+ * Open addressing hash index into an array owned by the caller. Slots store the
+ * array index plus one, zero marks an empty slot. Linear probing, with a power of
+ * two capacity kept at most half full.
+ *
+ * Indices are never removed one by one. After compacting its array the caller
+ * clears the index and inserts everything again, which reuses the slots. */
+
+class id_map_index {
+ public:
+  id_map_index() : slots(16, 0)
+  {
+  }
+
+  template<typename Match> int find(uint hash, const Match &match) const
+  {
+    const size_t mask = slots.size() - 1;
+    for (size_t slot = hash & mask;; slot = (slot + 1) & mask) {
+      const int index = slots[slot] - 1;
+      if (index == -1 || match(index)) {
+        return index;
+      }
+    }
+  }
+
+  /* Insert an index that is not in the index yet. */
+  void insert(uint hash, int index)
+  {
+    const size_t mask = slots.size() - 1;
+    size_t slot = hash & mask;
+    while (slots[slot] != 0) {
+      slot = (slot + 1) & mask;
+    }
+    slots[slot] = index + 1;
+  }
+
+  /* Grow to fit the given number of indices. Returns true if the slots were
+   * reallocated, all indices then need to be inserted again. */
+  bool reserve(size_t num_indices)
+  {
+    size_t num_slots = slots.size();
+    while (num_slots < num_indices * 2) {
+      num_slots *= 2;
+    }
+
+    if (num_slots == slots.size()) {
+      return false;
+    }
+
+    slots.clear();
+    slots.resize(num_slots, 0);
+    return true;
+  }
+
+  void clear()
+  {
+    memset(slots.data(), 0, sizeof(int) * slots.size());
+  }
+
+ protected:
+  vector<int> slots;
+};
+
 /* ID Map
  *
  * Utility class to map between Blender datablocks and Cycles data structures,
- * and keep track of recalc tags from the dependency graph. */
+ * and keep track of recalc tags from the dependency graph.
+ *
+ * Entries are stored in a dense array, looked up through hash indices on both
+ * key and data. Instead of a set of used data, each entry is stamped with the
+ * sync generation it was last used in, so pre_sync() is a counter increment and
+ * post_sync() compacts the arrays in place. */
 
 template<typename K, typename T> class id_map {
  public:
-  id_map(vector<T *> *scene_data_)
+  id_map(vector<T *> *scene_data_) : generation(1)
   {
     scene_data = scene_data_;
   }
@@ -44,22 +120,31 @@ template<typename K, typename T> class id_map {
 
   T *find(const K &key)
   {
-    if (b_map.find(key) != b_map.end()) {
-      T *data = b_map[key];
-      return data;
-    }
-
-    return NULL;
+    const int index = find_key(key);
+    return (index != -1) ? entries[index].second : NULL;
   }
 
   void set_recalc(const BL::ID &id)
   {
-    b_recalc.insert(id.ptr.data);
+    set_recalc(id.ptr.data);
   }
 
   void set_recalc(void *id_ptr)
   {
-    b_recalc.insert(id_ptr);
+    if (is_recalc(id_ptr)) {
+      return;
+    }
+
+    b_recalc.push_back(id_ptr);
+
+    if (recalc_index.reserve(b_recalc.size())) {
+      for (size_t i = 0; i < b_recalc.size(); i++) {
+        recalc_index.insert(id_map_hash(b_recalc[i]), i);
+      }
+    }
+    else {
+      recalc_index.insert(id_map_hash(id_ptr), b_recalc.size() - 1);
+    }
   }
 
   bool has_recalc()
@@ -69,7 +154,8 @@ template<typename K, typename T> class id_map {
 
   void pre_sync()
   {
-    used_set.clear();
+    /* Entries stamped with an older generation are unused. */
+    generation++;
   }
 
   /* Add new data. */
@@ -77,8 +163,7 @@ template<typename K, typename T> class id_map {
   {
     assert(find(key) == NULL);
     scene_data->push_back(data);
-    b_map[key] = data;
-    used(data);
+    add_entry(key, data, generation);
   }
 
   /* Update existing data. */
@@ -88,9 +173,9 @@ template<typename K, typename T> class id_map {
   }
   bool update(T *data, const BL::ID &id, const BL::ID &parent)
   {
-    bool recalc = (b_recalc.find(id.ptr.data) != b_recalc.end());
+    bool recalc = is_recalc(id.ptr.data);
     if (parent.ptr.data && parent.ptr.data != id.ptr.data) {
-      recalc = recalc || (b_recalc.find(parent.ptr.data) != b_recalc.end());
+      recalc = recalc || is_recalc(parent.ptr.data);
     }
     used(data);
     return recalc;
@@ -129,70 +214,139 @@ template<typename K, typename T> class id_map {
 
   bool is_used(const K &key)
   {
-    T *data = find(key);
-    return (data) ? used_set.find(data) != used_set.end() : false;
+    const int index = find_key(key);
+    return (index != -1) ? entry_generation[index] == generation : false;
   }
 
   void used(T *data)
   {
     /* tag data as still in use */
-    used_set.insert(data);
+    const int index = find_data(data);
+    if (index != -1) {
+      entry_generation[index] = generation;
+    }
   }
 
   void set_default(T *data)
   {
-    b_map[NULL] = data;
+    const int index = find_key(NULL);
+
+    if (index == -1) {
+      add_entry(NULL, data, 0);
+    }
+    else if (entries[index].second != data) {
+      entries[index].second = data;
+      rebuild_index();
+    }
   }
 
   bool post_sync(bool do_delete = true)
   {
     /* remove unused data */
-    vector<T *> new_scene_data;
-    typename vector<T *>::iterator it;
     bool deleted = false;
 
-    for (it = scene_data->begin(); it != scene_data->end(); it++) {
-      T *data = *it;
+    if (do_delete) {
+      size_t num_scene_data = 0;
 
-      if (do_delete && used_set.find(data) == used_set.end()) {
-        delete data;
-        deleted = true;
-      }
-      else
-        new_scene_data.push_back(data);
-    }
+      for (size_t i = 0; i < scene_data->size(); i++) {
+        T *data = (*scene_data)[i];
+        const int index = find_data(data);
 
-    *scene_data = new_scene_data;
+        if (index == -1 || entry_generation[index] != generation) {
+          delete data;
+          deleted = true;
+        }
+        else {
+          (*scene_data)[num_scene_data++] = data;
+        }
+      }
 
-    /* update mapping */
-    map<K, T *> new_map;
-    typedef pair<const K, T *> TMapPair;
-    typename map<K, T *>::iterator jt;
+      scene_data->resize(num_scene_data);
+    }
 
-    for (jt = b_map.begin(); jt != b_map.end(); jt++) {
-      TMapPair &pair = *jt;
+    /* update mapping, entries of deleted data are unused as well */
+    size_t num_entries = 0;
 
-      if (used_set.find(pair.second) != used_set.end())
-        new_map[pair.first] = pair.second;
+    for (size_t i = 0; i < entries.size(); i++) {
+      if (entry_generation[i] == generation) {
+        entries[num_entries] = entries[i];
+        entry_generation[num_entries] = entry_generation[i];
+        num_entries++;
+      }
     }
 
-    used_set.clear();
+    entries.erase(entries.begin() + num_entries, entries.end());
+    entry_generation.resize(num_entries);
+    rebuild_index();
+
     b_recalc.clear();
-    b_map = new_map;
+    recalc_index.clear();
+    generation++;
 
     return deleted;
   }
 
-  const map<K, T *> &key_to_scene_data()
+  const vector<pair<K, T *>> &key_to_scene_data()
   {
-    return b_map;
+    return entries;
   }
 
  protected:
+  int find_key(const K &key) const
+  {
+    return key_index.find(id_map_hash(key),
+                          [&](int index) { return entries[index].first == key; });
+  }
+
+  int find_data(const T *data) const
+  {
+    return data_index.find(id_map_hash(data),
+                           [&](int index) { return entries[index].second == data; });
+  }
+
+  bool is_recalc(const void *id_ptr) const
+  {
+    return recalc_index.find(id_map_hash(id_ptr),
+                             [&](int index) { return b_recalc[index] == id_ptr; }) != -1;
+  }
+
+  void add_entry(const K &key, T *data, uint used_generation)
+  {
+    entries.push_back(pair<K, T *>(key, data));
+    entry_generation.push_back(used_generation);
+
+    const int index = entries.size() - 1;
+    const bool key_index_grown = key_index.reserve(entries.size());
+    const bool data_index_grown = data_index.reserve(entries.size());
+
+    if (key_index_grown || data_index_grown) {
+      rebuild_index();
+    }
+    else {
+      key_index.insert(id_map_hash(key), index);
+      data_index.insert(id_map_hash(data), index);
+    }
+  }
+
+  void rebuild_index()
+  {
+    key_index.clear();
+    data_index.clear();
+
+    for (size_t i = 0; i < entries.size(); i++) {
+      key_index.insert(id_map_hash(entries[i].first), i);
+      data_index.insert(id_map_hash(entries[i].second), i);
+    }
+  }
+
   vector<T *> *scene_data;
-  map<K, T *> b_map;
-  set<T *> used_set;
-  set<void *> b_recalc;
+  vector<pair<K, T *>> entries;
+  vector<uint> entry_generation;
+  id_map_index key_index;
+  id_map_index data_index;
+  uint generation;
+  vector<void *> b_recalc;
+  id_map_index recalc_index;
 };
 
 /* Object Key
@@ -217,29 +371,22 @@ struct ObjectKey {
       memset(id, 0, sizeof(id));
   }
 
-  bool operator<(const ObjectKey &k) const
+  bool operator==(const ObjectKey &k) const
   {
-    if (ob < k.ob) {
-      return true;
-    }
-    else if (ob == k.ob) {
-      if (parent < k.parent) {
-        return true;
-      }
-      else if (parent == k.parent) {
-        if (use_particle_hair < k.use_particle_hair) {
-          return true;
-        }
-        else if (use_particle_hair == k.use_particle_hair) {
-          return memcmp(id, k.id, sizeof(id)) < 0;
-        }
-      }
-    }
-
-    return false;
+    return (ob == k.ob) && (parent == k.parent) && (use_particle_hair == k.use_particle_hair) &&
+           memcmp(id, k.id, sizeof(id)) == 0;
   }
 };
 
+inline uint id_map_hash(const ObjectKey &k)
+{
+  uint hash = hash_uint2(id_map_hash(k.ob), id_map_hash(k.parent));
+  for (int i = 0; i < OBJECT_PERSISTENT_ID_SIZE; i++) {
+    hash = hash_uint2(hash, (uint)k.id[i]);
+  }
+  return hash_uint2(hash, k.use_particle_hair);
+}
+
 /* Geometry Key
  *
  * We export separate geometry for a mesh and its particle hair, so key needs to
@@ -253,21 +400,17 @@ struct GeometryKey {
   {
   }
 
-  bool operator<(const GeometryKey &k) const
+  bool operator==(const GeometryKey &k) const
   {
-    if (id < k.id) {
-      return true;
-    }
-    else if (id == k.id) {
-      if (use_particle_hair < k.use_particle_hair) {
-        return true;
-      }
-    }
-
-    return false;
+    return (id == k.id) && (use_particle_hair == k.use_particle_hair);
   }
 };
 
+inline uint id_map_hash(const GeometryKey &k)
+{
+  return hash_uint2(id_map_hash(k.id), k.use_particle_hair);
+}
+
 /* Particle System Key */
 
 struct ParticleSystemKey {
@@ -282,18 +425,24 @@ struct ParticleSystemKey {
       memset(id, 0, sizeof(id));
   }
 
-  bool operator<(const ParticleSystemKey &k) const
+  bool operator==(const ParticleSystemKey &k) const
   {
     /* first id is particle index, we don't compare that */
-    if (ob < k.ob)
-      return true;
-    else if (ob == k.ob)
-      return memcmp(id + 1, k.id + 1, sizeof(int) * (OBJECT_PERSISTENT_ID_SIZE - 1)) < 0;
-
-    return false;
+    return (ob == k.ob) &&
+           memcmp(id + 1, k.id + 1, sizeof(int) * (OBJECT_PERSISTENT_ID_SIZE - 1)) == 0;
   }
 };
 
+inline uint id_map_hash(const ParticleSystemKey &k)
+{
+  /* first id is particle index, we don't hash that */
+  uint hash = id_map_hash(k.ob);
+  for (int i = 1; i < OBJECT_PERSISTENT_ID_SIZE; i++) {
+    hash = hash_uint2(hash, (uint)k.id[i]);
+  }
+  return hash;
+}
+
 CCL_NAMESPACE_END
 
 #endif /* __BLENDER_ID_MAP_H__ */
@@ -22,6 +22,70 @@
 
 CCL_NAMESPACE_BEGIN
 
+/* Pixel Conversion
+ *
+ * Scene preparation with many packed images spends its time in these loops,
+ * so they run over chunks of pixels on the task pool, with SSE2 for the byte
+ * premultiply. */
+
+/* Fill with magenta, or zero for single channel images, when the pixels are
+ * not available or have an unexpected size. */
+template<typename T>
+static void image_fill_missing(T *pixels, size_t num_pixels, int channels, T one)
+{
+  if (channels == 1) {
+    memset(pixels, 0, num_pixels * sizeof(T));
+    return;
+  }
+
+  parallel_for_range((int)num_pixels, [&](int start, int end) {
+    T *p = pixels + (size_t)start * channels;
+    for (int i = start; i < end; i++, p += channels) {
+      p[0] = one;
+      p[1] = T(0);
+      p[2] = one;
+      if (channels == 4) {
+        p[3] = one;
+      }
+    }
+  });
+}
+
+/* Premultiply RGBA bytes by alpha, rounding down like Blender does. */
+static void image_associate_alpha_byte4(uchar *pixels, size_t num_pixels)
+{
+  parallel_for_range((int)num_pixels, [&](int start, int end) {
+    uchar *cp = pixels + (size_t)start * 4;
+    int i = start;
+
+#ifdef __KERNEL_SSE2__
+    /* Four pixels at a time, widened to 16 bit where alpha is broadcast to
+     * the other channels of its pixel. */
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i alpha_mask = _mm_set1_epi32((int)0xFF000000);
+    for (; i + 4 <= end; i += 4, cp += 16) {
+      const __m128i rgba = _mm_loadu_si128((const __m128i *)cp);
+      __m128i lo = _mm_unpacklo_epi8(rgba, zero);
+      __m128i hi = _mm_unpackhi_epi8(rgba, zero);
+      const __m128i alpha_lo = _mm_shufflehi_epi16(_mm_shufflelo_epi16(lo, 0xFF), 0xFF);
+      const __m128i alpha_hi = _mm_shufflehi_epi16(_mm_shufflelo_epi16(hi, 0xFF), 0xFF);
+      lo = _mm_srli_epi16(_mm_mullo_epi16(lo, alpha_lo), 8);
+      hi = _mm_srli_epi16(_mm_mullo_epi16(hi, alpha_hi), 8);
+      const __m128i result = _mm_packus_epi16(lo, hi);
+      _mm_storeu_si128((__m128i *)cp,
+                       _mm_or_si128(_mm_andnot_si128(alpha_mask, result),
+                                    _mm_and_si128(alpha_mask, rgba)));
+    }
+#endif
+
+    for (; i < end; i++, cp += 4) {
+      cp[0] = (cp[0] * cp[3]) >> 8;
+      cp[1] = (cp[1] * cp[3]) >> 8;
+      cp[2] = (cp[2] * cp[3]) >> 8;
+    }
+  });
+}
+
 /* Packed Images */
 
 BlenderImageLoader::BlenderImageLoader(BL::Image b_image, int frame)
@@ -84,21 +148,7 @@ bool BlenderImageLoader::load_pixels(const ImageMetaData &metadata,
       memcpy(pixels, image_pixels, pixels_size * sizeof(float));
     }
     else {
-      if (channels == 1) {
-        memset(pixels, 0, num_pixels * sizeof(float));
-      }
-      else {
-        const size_t num_pixels_safe = pixels_size / channels;
-        float *fp = (float *)pixels;
-        for (int i = 0; i < num_pixels_safe; i++, fp += channels) {
-          fp[0] = 1.0f;
-          fp[1] = 0.0f;
-          fp[2] = 1.0f;
-          if (channels == 4) {
-            fp[3] = 1.0f;
-          }
-        }
-      }
+      image_fill_missing((float *)pixels, pixels_size / channels, channels, 1.0f);
     }
 
     if (image_pixels) {
@@ -112,35 +162,16 @@ bool BlenderImageLoader::load_pixels(const ImageMetaData &metadata,
       memcpy(pixels, image_pixels, pixels_size * sizeof(unsigned char));
     }
     else {
-      if (channels == 1) {
-        memset(pixels, 0, pixels_size * sizeof(unsigned char));
-      }
-      else {
-        const size_t num_pixels_safe = pixels_size / channels;
-        unsigned char *cp = (unsigned char *)pixels;
-        for (size_t i = 0; i < num_pixels_safe; i++, cp += channels) {
-          cp[0] = 255;
-          cp[1] = 0;
-          cp[2] = 255;
-          if (channels == 4) {
-            cp[3] = 255;
-          }
-        }
-      }
+      image_fill_missing((uchar *)pixels, pixels_size / channels, channels, (uchar)255);
     }
 
     if (image_pixels) {
       MEM_freeN(image_pixels);
     }
 
-    if (associate_alpha) {
+    if (associate_alpha && channels == 4) {
       /* Premultiply, byte images are always straight for Blender. */
-      unsigned char *cp = (unsigned char *)pixels;
-      for (size_t i = 0; i < num_pixels; i++, cp += channels) {
-        cp[0] = (cp[0] * cp[3]) >> 8;
-        cp[1] = (cp[1] * cp[3]) >> 8;
-        cp[2] = (cp[2] * cp[3]) >> 8;
-      }
+      image_associate_alpha_byte4((uchar *)pixels, num_pixels);
     }
   }
 
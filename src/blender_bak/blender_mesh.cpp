@@ -14,6 +14,8 @@
  * limitations under the License.
  */
 
+#include <atomic>
+
 #include "render/camera.h"
 #include "render/colorspace.h"
 #include "render/mesh.h"
@@ -28,14 +30,16 @@
 #include "subd/subd_split.h"
 
 #include "util/util_algorithm.h"
-#include "util/util_disjoint_set.h"
 #include "util/util_foreach.h"
 #include "util/util_hash.h"
 #include "util/util_logging.h"
 #include "util/util_math.h"
+#include "util/util_task.h"
 
 #include "mikktspace.h"
 
+#include "DNA_meshdata_types.h"
+
 CCL_NAMESPACE_BEGIN
 
 /* Tangent Space */
@@ -218,7 +222,10 @@ static void mikk_set_tangent_space(const SMikkTSpaceContext *context,
   }
 }
 
-static void mikk_compute_tangents(
+/* Create the tangent attributes for a UV map. Adding attributes is not thread
+ * safe, so this runs serially, the returned userdata can then be computed on
+ * any thread. */
+static MikkUserData mikk_setup_tangents(
     const BL::Mesh &b_mesh, const char *layer_name, Mesh *mesh, bool need_sign, bool active_render)
 {
   /* Create tangent attributes. */
@@ -259,7 +266,11 @@ static void mikk_compute_tangents(
     tangent_sign = attr_sign->data_float();
   }
   /* Setup userdata. */
-  MikkUserData userdata(b_mesh, layer_name, mesh, tangent, tangent_sign);
+  return MikkUserData(b_mesh, layer_name, mesh, tangent, tangent_sign);
+}
+
+static void mikk_compute_tangents(MikkUserData *userdata)
+{
   /* Setup interface. */
   SMikkTSpaceInterface sm_interface;
   memset(&sm_interface, 0, sizeof(sm_interface));
@@ -272,97 +283,178 @@ static void mikk_compute_tangents(
   /* Setup context. */
   SMikkTSpaceContext context;
   memset(&context, 0, sizeof(context));
-  context.m_pUserData = &userdata;
+  context.m_pUserData = userdata;
   context.m_pInterface = &sm_interface;
   /* Compute tangents. */
   genTangSpaceDefault(&context);
 }
 
-/* Create vertex color attributes. */
-static void attr_create_vertex_color(Scene *scene, Mesh *mesh, BL::Mesh &b_mesh, bool subdivision)
+/* UV maps are independent, compute their tangents in parallel. */
+static void mikk_compute_tangents(vector<MikkUserData> &userdata)
 {
-  if (subdivision) {
-    BL::Mesh::vertex_colors_iterator l;
-
-    for (b_mesh.vertex_colors.begin(l); l != b_mesh.vertex_colors.end(); ++l) {
-      const bool active_render = l->active_render();
-      AttributeStandard vcol_std = (active_render) ? ATTR_STD_VERTEX_COLOR : ATTR_STD_NONE;
-      ustring vcol_name = ustring(l->name().c_str());
+  if (userdata.size() == 1) {
+    mikk_compute_tangents(&userdata[0]);
+    return;
+  }
 
-      const bool need_vcol = mesh->need_attribute(scene, vcol_name) ||
-                             mesh->need_attribute(scene, vcol_std);
+  TaskPool pool;
+  for (size_t i = 0; i < userdata.size(); i++) {
+    MikkUserData *layer_userdata = &userdata[i];
+    pool.push([layer_userdata]() { mikk_compute_tangents(layer_userdata); });
+  }
+  pool.wait_work();
+}
 
-      if (!need_vcol) {
-        continue;
-      }
+/* Blender loop index of every corner of the Cycles mesh, in the order corner
+ * attributes are stored: three per triangle, or the loops of each subdivision
+ * face. Lets the corner attributes below read the DNA loop layers directly
+ * instead of going through RNA for every loop of every layer. */
+static void mesh_corner_loops(BL::Mesh &b_mesh, bool subdivision, vector<int> &corner_loops)
+{
+  corner_loops.clear();
 
-      Attribute *vcol_attr = NULL;
-      if (active_render) {
-        vcol_attr = mesh->subd_attributes.add(vcol_std, vcol_name);
-      }
-      else {
-        vcol_attr = mesh->subd_attributes.add(vcol_name, TypeRGBA, ATTR_ELEMENT_CORNER_BYTE);
-      }
+  if (!subdivision) {
+    const int num_tris = b_mesh.loop_triangles.length();
+    if (num_tris == 0) {
+      return;
+    }
 
-      BL::Mesh::polygons_iterator p;
-      uchar4 *cdata = vcol_attr->data_uchar4();
+    const MLoopTri *b_looptris = (const MLoopTri *)b_mesh.loop_triangles[0].ptr.data;
+    corner_loops.resize(num_tris * 3);
 
-      for (b_mesh.polygons.begin(p); p != b_mesh.polygons.end(); ++p) {
-        int n = p->loop_total();
-        for (int i = 0; i < n; i++) {
-          float4 color = get_float4(l->data[p->loop_start() + i].color());
-          /* Compress/encode vertex color using the sRGB curve. */
-          *(cdata++) = color_float4_to_uchar4(color_srgb_to_linear_v4(color));
-        }
+    for (int i = 0; i < num_tris; i++) {
+      for (int j = 0; j < 3; j++) {
+        corner_loops[i * 3 + j] = b_looptris[i].tri[j];
       }
     }
   }
   else {
-    BL::Mesh::vertex_colors_iterator l;
-    for (b_mesh.vertex_colors.begin(l); l != b_mesh.vertex_colors.end(); ++l) {
-      const bool active_render = l->active_render();
-      AttributeStandard vcol_std = (active_render) ? ATTR_STD_VERTEX_COLOR : ATTR_STD_NONE;
-      ustring vcol_name = ustring(l->name().c_str());
+    const int num_polys = b_mesh.polygons.length();
+    if (num_polys == 0) {
+      return;
+    }
 
-      const bool need_vcol = mesh->need_attribute(scene, vcol_name) ||
-                             mesh->need_attribute(scene, vcol_std);
+    const MPoly *b_polys = (const MPoly *)b_mesh.polygons[0].ptr.data;
+    corner_loops.reserve(b_mesh.loops.length());
 
-      if (!need_vcol) {
-        continue;
+    for (int i = 0; i < num_polys; i++) {
+      for (int j = 0; j < b_polys[i].totloop; j++) {
+        corner_loops.push_back(b_polys[i].loopstart + j);
       }
+    }
+  }
+}
 
-      Attribute *vcol_attr = NULL;
-      if (active_render) {
-        vcol_attr = mesh->attributes.add(vcol_std, vcol_name);
-      }
-      else {
-        vcol_attr = mesh->attributes.add(vcol_name, TypeRGBA, ATTR_ELEMENT_CORNER_BYTE);
-      }
+static void gather_loop_colors(const MLoopCol *b_loopcols,
+                               const vector<int> &corner_loops,
+                               const uchar *srgb_to_linear,
+                               uchar4 *cdata)
+{
+  const int num_corners = corner_loops.size();
 
-      BL::Mesh::loop_triangles_iterator t;
-      uchar4 *cdata = vcol_attr->data_uchar4();
+  for (int i = 0; i < num_corners; i++) {
+    const MLoopCol &b_loopcol = b_loopcols[corner_loops[i]];
+    cdata[i] = make_uchar4(srgb_to_linear[b_loopcol.r],
+                           srgb_to_linear[b_loopcol.g],
+                           srgb_to_linear[b_loopcol.b],
+                           b_loopcol.a);
+  }
+}
 
-      for (b_mesh.loop_triangles.begin(t); t != b_mesh.loop_triangles.end(); ++t) {
-        int3 li = get_int3(t->loops());
-        float4 c1 = get_float4(l->data[li[0]].color());
-        float4 c2 = get_float4(l->data[li[1]].color());
-        float4 c3 = get_float4(l->data[li[2]].color());
-
-        /* Compress/encode vertex color using the sRGB curve. */
-        cdata[0] = color_float4_to_uchar4(color_srgb_to_linear_v4(c1));
-        cdata[1] = color_float4_to_uchar4(color_srgb_to_linear_v4(c2));
-        cdata[2] = color_float4_to_uchar4(color_srgb_to_linear_v4(c3));
-        cdata += 3;
-      }
+static void gather_loop_uvs(const MLoopUV *b_loopuvs,
+                            const vector<int> &corner_loops,
+                            float2 *fdata)
+{
+  const int num_corners = corner_loops.size();
+
+  for (int i = 0; i < num_corners; i++) {
+    const MLoopUV &b_loopuv = b_loopuvs[corner_loops[i]];
+    fdata[i] = make_float2(b_loopuv.uv[0], b_loopuv.uv[1]);
+  }
+}
+
+/* Create vertex color attributes. */
+static void attr_create_vertex_color(Scene *scene,
+                                     Mesh *mesh,
+                                     BL::Mesh &b_mesh,
+                                     const vector<int> &corner_loops,
+                                     bool subdivision)
+{
+  AttributeSet &attributes = (subdivision) ? mesh->subd_attributes : mesh->attributes;
+
+  /* Compress/encode vertex color using the sRGB curve. Blender stores bytes,
+   * so the conversion of each channel is a table lookup. */
+  uchar srgb_to_linear[256];
+  for (int i = 0; i < 256; i++) {
+    const float f = i * (1.0f / 255.0f);
+    const float4 color = color_srgb_to_linear_v4(make_float4(f, f, f, 1.0f));
+    srgb_to_linear[i] = color_float4_to_uchar4(color).x;
+  }
+
+  /* Layers are gathered concurrently, one task each. */
+  TaskPool pool;
+  BL::Mesh::vertex_colors_iterator l;
+
+  for (b_mesh.vertex_colors.begin(l); l != b_mesh.vertex_colors.end(); ++l) {
+    const bool active_render = l->active_render();
+    AttributeStandard vcol_std = (active_render) ? ATTR_STD_VERTEX_COLOR : ATTR_STD_NONE;
+    ustring vcol_name = ustring(l->name().c_str());
+
+    const bool need_vcol = mesh->need_attribute(scene, vcol_name) ||
+                           mesh->need_attribute(scene, vcol_std);
+
+    if (!need_vcol || attributes.find(vcol_name)) {
+      continue;
+    }
+
+    Attribute *vcol_attr = NULL;
+    if (active_render) {
+      vcol_attr = attributes.add(vcol_std, vcol_name);
+    }
+    else {
+      vcol_attr = attributes.add(vcol_name, TypeRGBA, ATTR_ELEMENT_CORNER_BYTE);
     }
+
+    if (corner_loops.empty()) {
+      continue;
+    }
+
+    const MLoopCol *b_loopcols = (const MLoopCol *)l->data[0].ptr.data;
+    uchar4 *cdata = vcol_attr->data_uchar4();
+
+    pool.push([b_loopcols, &corner_loops, &srgb_to_linear, cdata]() {
+      gather_loop_colors(b_loopcols, corner_loops, srgb_to_linear, cdata);
+    });
+  }
+
+  pool.wait_work();
+}
+
+/* Tangent from generated coordinates for meshes without UV maps, requested
+ * but not computed yet. */
+static bool need_default_tangent(Scene *scene, Mesh *mesh, const AttributeSet &attributes)
+{
+  if (!mesh->need_attribute(scene, ATTR_STD_UV_TANGENT)) {
+    return false;
   }
+
+  return !attributes.find(ATTR_STD_UV_TANGENT) ||
+         (mesh->need_attribute(scene, ATTR_STD_UV_TANGENT_SIGN) &&
+          !attributes.find(ATTR_STD_UV_TANGENT_SIGN));
 }
 
 /* Create uv map attributes. */
-static void attr_create_uv_map(Scene *scene, Mesh *mesh, BL::Mesh &b_mesh)
+static void attr_create_uv_map(Scene *scene,
+                               Mesh *mesh,
+                               BL::Mesh &b_mesh,
+                               const vector<int> &corner_loops)
 {
   if (b_mesh.uv_layers.length() != 0) {
+    /* Layers are gathered concurrently, one task each. */
+    TaskPool pool;
     BL::Mesh::uv_layers_iterator l;
+    vector<MikkUserData> tangent_userdata;
+    vector<Attribute *> temp_uv_attrs;
 
     for (b_mesh.uv_layers.begin(l); l != b_mesh.uv_layers.end(); ++l) {
       const bool active_render = l->active_render();
@@ -375,15 +467,24 @@ static void attr_create_uv_map(Scene *scene, Mesh *mesh, BL::Mesh &b_mesh)
       const bool need_uv = mesh->need_attribute(scene, uv_name) ||
                            mesh->need_attribute(scene, uv_std);
       /* Denotes whether tangent was requested directly. */
-      const bool need_tangent = mesh->need_attribute(scene, tangent_name) ||
-                                (active_render && mesh->need_attribute(scene, tangent_std));
+      bool need_tangent = mesh->need_attribute(scene, tangent_name) ||
+                          (active_render && mesh->need_attribute(scene, tangent_std));
+      AttributeStandard sign_std = (active_render) ? ATTR_STD_UV_TANGENT_SIGN : ATTR_STD_NONE;
+      ustring sign_name = ustring((string(l->name().c_str()) + ".tangent_sign").c_str());
+      const bool need_sign = (mesh->need_attribute(scene, sign_name) ||
+                              mesh->need_attribute(scene, sign_std));
+
+      /* Attributes kept from an earlier sync of this mesh are not computed
+       * again, only the ones shaders started to use since then. */
+      need_tangent = need_tangent && (!mesh->attributes.find(tangent_name) ||
+                                      (need_sign && !mesh->attributes.find(sign_name)));
 
       /* UV map */
       /* NOTE: We create temporary UV layer if its needed for tangent but
        * wasn't requested by other nodes in shaders.
        */
       Attribute *uv_attr = NULL;
-      if (need_uv || need_tangent) {
+      if ((need_uv || need_tangent) && !mesh->attributes.find(uv_name)) {
         if (active_render) {
           uv_attr = mesh->attributes.add(uv_std, uv_name);
         }
@@ -391,45 +492,56 @@ static void attr_create_uv_map(Scene *scene, Mesh *mesh, BL::Mesh &b_mesh)
           uv_attr = mesh->attributes.add(uv_name, TypeFloat2, ATTR_ELEMENT_CORNER);
         }
 
-        BL::Mesh::loop_triangles_iterator t;
-        float2 *fdata = uv_attr->data_float2();
+        if (!corner_loops.empty()) {
+          const MLoopUV *b_loopuvs = (const MLoopUV *)l->data[0].ptr.data;
+          float2 *fdata = uv_attr->data_float2();
 
-        for (b_mesh.loop_triangles.begin(t); t != b_mesh.loop_triangles.end(); ++t) {
-          int3 li = get_int3(t->loops());
-          fdata[0] = get_float2(l->data[li[0]].uv());
-          fdata[1] = get_float2(l->data[li[1]].uv());
-          fdata[2] = get_float2(l->data[li[2]].uv());
-          fdata += 3;
+          pool.push([b_loopuvs, &corner_loops, fdata]() {
+            gather_loop_uvs(b_loopuvs, corner_loops, fdata);
+          });
         }
       }
 
       /* UV tangent */
       if (need_tangent) {
-        AttributeStandard sign_std = (active_render) ? ATTR_STD_UV_TANGENT_SIGN : ATTR_STD_NONE;
-        ustring sign_name = ustring((string(l->name().c_str()) + ".tangent_sign").c_str());
-        bool need_sign = (mesh->need_attribute(scene, sign_name) ||
-                          mesh->need_attribute(scene, sign_std));
-        mikk_compute_tangents(b_mesh, l->name().c_str(), mesh, need_sign, active_render);
+        tangent_userdata.push_back(
+            mikk_setup_tangents(b_mesh, l->name().c_str(), mesh, need_sign, active_render));
       }
-      /* Remove temporarily created UV attribute. */
+      /* Remove temporarily created UV attribute once tangents are computed. */
       if (!need_uv && uv_attr != NULL) {
-        mesh->attributes.remove(uv_attr);
+        temp_uv_attrs.push_back(uv_attr);
       }
     }
+
+    pool.wait_work();
+    mikk_compute_tangents(tangent_userdata);
+
+    foreach (Attribute *uv_attr, temp_uv_attrs) {
+      mesh->attributes.remove(uv_attr);
+    }
   }
-  else if (mesh->need_attribute(scene, ATTR_STD_UV_TANGENT)) {
+  else if (need_default_tangent(scene, mesh, mesh->attributes)) {
     bool need_sign = mesh->need_attribute(scene, ATTR_STD_UV_TANGENT_SIGN);
-    mikk_compute_tangents(b_mesh, NULL, mesh, need_sign, true);
+    MikkUserData userdata = mikk_setup_tangents(b_mesh, NULL, mesh, need_sign, true);
+    mikk_compute_tangents(&userdata);
     if (!mesh->need_attribute(scene, ATTR_STD_GENERATED)) {
       mesh->attributes.remove(ATTR_STD_GENERATED);
     }
   }
 }
 
-static void attr_create_subd_uv_map(Scene *scene, Mesh *mesh, BL::Mesh &b_mesh, bool subdivide_uvs)
+static void attr_create_subd_uv_map(Scene *scene,
+                                    Mesh *mesh,
+                                    BL::Mesh &b_mesh,
+                                    const vector<int> &corner_loops,
+                                    bool subdivide_uvs)
 {
   if (b_mesh.uv_layers.length() != 0) {
+    /* Layers are gathered concurrently, one task each. */
+    TaskPool pool;
     BL::Mesh::uv_layers_iterator l;
+    vector<MikkUserData> tangent_userdata;
+    vector<Attribute *> temp_uv_attrs;
     int i = 0;
 
     for (b_mesh.uv_layers.begin(l); l != b_mesh.uv_layers.end(); ++l, ++i) {
@@ -443,13 +555,22 @@ static void attr_create_subd_uv_map(Scene *scene, Mesh *mesh, BL::Mesh &b_mesh,
       const bool need_uv = mesh->need_attribute(scene, uv_name) ||
                            mesh->need_attribute(scene, uv_std);
       /* Denotes whether tangent was requested directly. */
-      const bool need_tangent = mesh->need_attribute(scene, tangent_name) ||
-                                (active_render && mesh->need_attribute(scene, tangent_std));
+      bool need_tangent = mesh->need_attribute(scene, tangent_name) ||
+                          (active_render && mesh->need_attribute(scene, tangent_std));
+      AttributeStandard sign_std = (active_render) ? ATTR_STD_UV_TANGENT_SIGN : ATTR_STD_NONE;
+      ustring sign_name = ustring((string(l->name().c_str()) + ".tangent_sign").c_str());
+      const bool need_sign = (mesh->need_attribute(scene, sign_name) ||
+                              mesh->need_attribute(scene, sign_std));
+
+      /* Attributes kept from an earlier sync of this mesh are not computed
+       * again, only the ones shaders started to use since then. */
+      need_tangent = need_tangent && (!mesh->subd_attributes.find(tangent_name) ||
+                                      (need_sign && !mesh->subd_attributes.find(sign_name)));
 
       Attribute *uv_attr = NULL;
 
       /* UV map */
-      if (need_uv || need_tangent) {
+      if ((need_uv || need_tangent) && !mesh->subd_attributes.find(uv_name)) {
         if (active_render)
           uv_attr = mesh->subd_attributes.add(uv_std, uv_name);
         else
@@ -459,34 +580,38 @@ static void attr_create_subd_uv_map(Scene *scene, Mesh *mesh, BL::Mesh &b_mesh,
           uv_attr->flags |= ATTR_SUBDIVIDED;
         }
 
-        BL::Mesh::polygons_iterator p;
-        float2 *fdata = uv_attr->data_float2();
+        if (!corner_loops.empty()) {
+          const MLoopUV *b_loopuvs = (const MLoopUV *)l->data[0].ptr.data;
+          float2 *fdata = uv_attr->data_float2();
 
-        for (b_mesh.polygons.begin(p); p != b_mesh.polygons.end(); ++p) {
-          int n = p->loop_total();
-          for (int j = 0; j < n; j++) {
-            *(fdata++) = get_float2(l->data[p->loop_start() + j].uv());
-          }
+          pool.push([b_loopuvs, &corner_loops, fdata]() {
+            gather_loop_uvs(b_loopuvs, corner_loops, fdata);
+          });
         }
       }
 
       /* UV tangent */
       if (need_tangent) {
-        AttributeStandard sign_std = (active_render) ? ATTR_STD_UV_TANGENT_SIGN : ATTR_STD_NONE;
-        ustring sign_name = ustring((string(l->name().c_str()) + ".tangent_sign").c_str());
-        bool need_sign = (mesh->need_attribute(scene, sign_name) ||
-                          mesh->need_attribute(scene, sign_std));
-        mikk_compute_tangents(b_mesh, l->name().c_str(), mesh, need_sign, active_render);
+        tangent_userdata.push_back(
+            mikk_setup_tangents(b_mesh, l->name().c_str(), mesh, need_sign, active_render));
       }
-      /* Remove temporarily created UV attribute. */
+      /* Remove temporarily created UV attribute once tangents are computed. */
       if (!need_uv && uv_attr != NULL) {
-        mesh->subd_attributes.remove(uv_attr);
+        temp_uv_attrs.push_back(uv_attr);
       }
     }
+
+    pool.wait_work();
+    mikk_compute_tangents(tangent_userdata);
+
+    foreach (Attribute *uv_attr, temp_uv_attrs) {
+      mesh->subd_attributes.remove(uv_attr);
+    }
   }
-  else if (mesh->need_attribute(scene, ATTR_STD_UV_TANGENT)) {
+  else if (need_default_tangent(scene, mesh, mesh->subd_attributes)) {
     bool need_sign = mesh->need_attribute(scene, ATTR_STD_UV_TANGENT_SIGN);
-    mikk_compute_tangents(b_mesh, NULL, mesh, need_sign, true);
+    MikkUserData userdata = mikk_setup_tangents(b_mesh, NULL, mesh, need_sign, true);
+    mikk_compute_tangents(&userdata);
     if (!mesh->need_attribute(scene, ATTR_STD_GENERATED)) {
       mesh->subd_attributes.remove(ATTR_STD_GENERATED);
     }
@@ -495,93 +620,125 @@ static void attr_create_subd_uv_map(Scene *scene, Mesh *mesh, BL::Mesh &b_mesh,
 
 /* Create vertex pointiness attributes. */
 
-/* Compare vertices by sum of their coordinates. */
-class VertexAverageComparator {
+/* Grid of welding distance sized cells, hashed into buckets of linked
+ * vertices, to find coincident vertices without sorting. */
+class VertexWeldGrid {
  public:
-  VertexAverageComparator(const array<float3> &verts) : verts_(verts)
+  VertexWeldGrid(const array<float3> &verts, float weld_distance)
+      : verts_(verts), inv_cell_size_(1.0f / weld_distance)
   {
+    const size_t num_verts = verts.size();
+    size_t num_buckets = 1;
+    while (num_buckets < num_verts * 2) {
+      num_buckets *= 2;
+    }
+
+    bucket_mask_ = num_buckets - 1;
+    bucket_head_.resize(num_buckets, -1);
+    next_.resize(num_verts);
+
+    /* Insert in reverse so every bucket lists its vertices by ascending index. */
+    for (int vert_index = (int)num_verts - 1; vert_index >= 0; --vert_index) {
+      int64_t c[3];
+      cell(verts[vert_index], c);
+      const size_t bucket = bucket_index(c, 0, 0, 0);
+      next_[vert_index] = bucket_head_[bucket];
+      bucket_head_[bucket] = vert_index;
+    }
   }
 
-  bool operator()(const int &vert_idx_a, const int &vert_idx_b)
+  /* Lowest index of the vertices within the welding distance of the given one,
+   * including itself. */
+  int find_first_duplicate(int vert_index, float weld_distance_sq) const
   {
-    const float3 &vert_a = verts_[vert_idx_a];
-    const float3 &vert_b = verts_[vert_idx_b];
-    if (vert_a == vert_b) {
-      /* Special case for doubles, so we ensure ordering. */
-      return vert_idx_a > vert_idx_b;
+    const float3 &co = verts_[vert_index];
+    int64_t c[3];
+    cell(co, c);
+
+    int first = vert_index;
+    for (int dx = -1; dx <= 1; dx++) {
+      for (int dy = -1; dy <= 1; dy++) {
+        for (int dz = -1; dz <= 1; dz++) {
+          const size_t bucket = bucket_index(c, dx, dy, dz);
+          for (int other = bucket_head_[bucket]; other != -1 && other < first;
+               other = next_[other]) {
+            if (len_squared(verts_[other] - co) < weld_distance_sq) {
+              first = other;
+              break;
+            }
+          }
+        }
+      }
     }
-    const float x1 = vert_a.x + vert_a.y + vert_a.z;
-    const float x2 = vert_b.x + vert_b.y + vert_b.z;
-    return x1 < x2;
+
+    return first;
   }
 
  protected:
+  void cell(const float3 &co, int64_t r_cell[3]) const
+  {
+    r_cell[0] = (int64_t)floorf(co.x * inv_cell_size_);
+    r_cell[1] = (int64_t)floorf(co.y * inv_cell_size_);
+    r_cell[2] = (int64_t)floorf(co.z * inv_cell_size_);
+  }
+
+  size_t bucket_index(const int64_t c[3], int dx, int dy, int dz) const
+  {
+    const uint64_t h = ((uint64_t)(c[0] + dx) * 73856093ULL) ^
+                       ((uint64_t)(c[1] + dy) * 19349663ULL) ^
+                       ((uint64_t)(c[2] + dz) * 83492791ULL);
+    return (size_t)(h ^ (h >> 29)) & bucket_mask_;
+  }
+
   const array<float3> &verts_;
+  float inv_cell_size_;
+  size_t bucket_mask_;
+  vector<int> bucket_head_;
+  vector<int> next_;
 };
 
 static void attr_create_pointiness(Scene *scene, Mesh *mesh, BL::Mesh &b_mesh, bool subdivision)
 {
-  if (!mesh->need_attribute(scene, ATTR_STD_POINTINESS)) {
+  AttributeSet &attributes = (subdivision) ? mesh->subd_attributes : mesh->attributes;
+  if (!mesh->need_attribute(scene, ATTR_STD_POINTINESS) || attributes.find(ATTR_STD_POINTINESS)) {
     return;
   }
   const int num_verts = b_mesh.vertices.length();
   if (num_verts == 0) {
     return;
   }
+  const MVert *b_verts = (const MVert *)b_mesh.vertices[0].ptr.data;
+  const array<float3> &verts = mesh->verts;
   /* STEP 1: Find out duplicated vertices and point duplicates to a single
    *         original vertex.
    */
-  vector<int> sorted_vert_indeices(num_verts);
-  for (int vert_index = 0; vert_index < num_verts; ++vert_index) {
-    sorted_vert_indeices[vert_index] = vert_index;
-  }
-  VertexAverageComparator compare(mesh->verts);
-  sort(sorted_vert_indeices.begin(), sorted_vert_indeices.end(), compare);
   /* This array stores index of the original vertex for the given vertex
    * index.
    */
   vector<int> vert_orig_index(num_verts);
-  for (int sorted_vert_index = 0; sorted_vert_index < num_verts; ++sorted_vert_index) {
-    const int vert_index = sorted_vert_indeices[sorted_vert_index];
-    const float3 &vert_co = mesh->verts[vert_index];
-    bool found = false;
-    for (int other_sorted_vert_index = sorted_vert_index + 1; other_sorted_vert_index < num_verts;
-         ++other_sorted_vert_index) {
-      const int other_vert_index = sorted_vert_indeices[other_sorted_vert_index];
-      const float3 &other_vert_co = mesh->verts[other_vert_index];
-      /* We are too far away now, we wouldn't have duplicate. */
-      if ((other_vert_co.x + other_vert_co.y + other_vert_co.z) -
-              (vert_co.x + vert_co.y + vert_co.z) >
-          3 * FLT_EPSILON) {
-        break;
-      }
-      /* Found duplicate. */
-      if (len_squared(other_vert_co - vert_co) < FLT_EPSILON) {
-        found = true;
-        vert_orig_index[vert_index] = other_vert_index;
-        break;
+  {
+    const float weld_distance = 3.0f * FLT_EPSILON;
+    VertexWeldGrid grid(verts, weld_distance);
+    parallel_for_range(num_verts, [&](int start, int end) {
+      for (int vert_index = start; vert_index < end; ++vert_index) {
+        vert_orig_index[vert_index] = grid.find_first_duplicate(vert_index,
+                                                                weld_distance * weld_distance);
       }
-    }
-    if (!found) {
-      vert_orig_index[vert_index] = vert_index;
-    }
+    });
   }
-  /* Make sure we always points to the very first orig vertex. */
+  /* Make sure we always points to the very first orig vertex. Duplicates
+   * point to lower indices, so resolving in order takes a single pass. */
   for (int vert_index = 0; vert_index < num_verts; ++vert_index) {
-    int orig_index = vert_orig_index[vert_index];
-    while (orig_index != vert_orig_index[orig_index]) {
-      orig_index = vert_orig_index[orig_index];
-    }
-    vert_orig_index[vert_index] = orig_index;
+    vert_orig_index[vert_index] = vert_orig_index[vert_orig_index[vert_index]];
   }
-  sorted_vert_indeices.free_memory();
   /* STEP 2: Calculate vertex normals taking into account their possible
    *         duplicates which gets "welded" together.
    */
   vector<float3> vert_normal(num_verts, make_float3(0.0f, 0.0f, 0.0f));
   /* First we accumulate all vertex normals in the original index. */
   for (int vert_index = 0; vert_index < num_verts; ++vert_index) {
-    const float3 normal = get_float3(b_mesh.vertices[vert_index].normal());
+    const short *no = b_verts[vert_index].no;
+    const float3 normal = make_float3(no[0], no[1], no[2]) * (1.0f / 32767.0f);
     const int orig_index = vert_orig_index[vert_index];
     vert_normal[orig_index] += normal;
   }
@@ -592,73 +749,140 @@ static void attr_create_pointiness(Scene *scene, Mesh *mesh, BL::Mesh &b_mesh, b
     const int orig_index = vert_orig_index[vert_index];
     vert_normal[vert_index] = normalize(vert_normal[orig_index]);
   }
-  /* STEP 3: Calculate pointiness using single ring neighborhood. */
-  vector<int> counter(num_verts, 0);
-  vector<float> raw_data(num_verts, 0.0f);
-  vector<float3> edge_accum(num_verts, make_float3(0.0f, 0.0f, 0.0f));
-  BL::Mesh::edges_iterator e;
-  EdgeMap visited_edges;
-  int edge_index = 0;
-  memset(&counter[0], 0, sizeof(int) * counter.size());
-  for (b_mesh.edges.begin(e); e != b_mesh.edges.end(); ++e, ++edge_index) {
-    const int v0 = vert_orig_index[b_mesh.edges[edge_index].vertices()[0]],
-              v1 = vert_orig_index[b_mesh.edges[edge_index].vertices()[1]];
-    if (visited_edges.exists(v0, v1)) {
-      continue;
+  /* STEP 3: Build adjacency between original vertices from the edge array,
+   *         as compressed rows without duplicate edges.
+   */
+  const int num_edges = b_mesh.edges.length();
+  const MEdge *b_edges = (num_edges) ? (const MEdge *)b_mesh.edges[0].ptr.data : NULL;
+  vector<int> adjacency_start(num_verts + 1, 0);
+  vector<int> adjacency_count(num_verts, 0);
+  for (int edge_index = 0; edge_index < num_edges; ++edge_index) {
+    const int v0 = vert_orig_index[b_edges[edge_index].v1],
+              v1 = vert_orig_index[b_edges[edge_index].v2];
+    if (v0 != v1) {
+      ++adjacency_start[v0 + 1];
+      ++adjacency_start[v1 + 1];
     }
-    visited_edges.insert(v0, v1);
-    float3 co0 = get_float3(b_mesh.vertices[v0].co()), co1 = get_float3(b_mesh.vertices[v1].co());
-    float3 edge = normalize(co1 - co0);
-    edge_accum[v0] += edge;
-    edge_accum[v1] += -edge;
-    ++counter[v0];
-    ++counter[v1];
   }
   for (int vert_index = 0; vert_index < num_verts; ++vert_index) {
-    const int orig_index = vert_orig_index[vert_index];
-    if (orig_index != vert_index) {
-      /* Skip duplicates, they'll be overwritten later on. */
-      continue;
+    adjacency_start[vert_index + 1] += adjacency_start[vert_index];
+  }
+  vector<int> adjacency(adjacency_start[num_verts]);
+  for (int edge_index = 0; edge_index < num_edges; ++edge_index) {
+    const int v0 = vert_orig_index[b_edges[edge_index].v1],
+              v1 = vert_orig_index[b_edges[edge_index].v2];
+    if (v0 != v1) {
+      adjacency[adjacency_start[v0] + adjacency_count[v0]++] = v1;
+      adjacency[adjacency_start[v1] + adjacency_count[v1]++] = v0;
+    }
+  }
+  /* Welding can turn several edges into the same one, count those once. */
+  parallel_for_range(num_verts, [&](int start, int end) {
+    for (int vert_index = start; vert_index < end; ++vert_index) {
+      int *row = &adjacency[0] + adjacency_start[vert_index];
+      std::sort(row, row + adjacency_count[vert_index]);
+      adjacency_count[vert_index] = std::unique(row, row + adjacency_count[vert_index]) - row;
     }
-    if (counter[vert_index] > 0) {
+  });
+  /* STEP 4: Calculate pointiness using single ring neighborhood. */
+  vector<float> raw_data(num_verts, 0.0f);
+  parallel_for_range(num_verts, [&](int start, int end) {
+    for (int vert_index = start; vert_index < end; ++vert_index) {
+      const int orig_index = vert_orig_index[vert_index];
+      const int count = adjacency_count[vert_index];
+      if (orig_index != vert_index || count == 0) {
+        /* Skip duplicates, they'll be overwritten later on. */
+        continue;
+      }
+      const float3 &co = verts[vert_index];
+      const int *row = &adjacency[adjacency_start[vert_index]];
+      float3 edge_accum = make_float3(0.0f, 0.0f, 0.0f);
+      for (int i = 0; i < count; i++) {
+        edge_accum += normalize(verts[row[i]] - co);
+      }
       const float3 normal = vert_normal[vert_index];
-      const float angle = safe_acosf(dot(normal, edge_accum[vert_index] / counter[vert_index]));
+      const float angle = safe_acosf(dot(normal, edge_accum / count));
       raw_data[vert_index] = angle * M_1_PI_F;
     }
-    else {
-      raw_data[vert_index] = 0.0f;
-    }
-  }
-  /* STEP 3: Blur vertices to approximate 2 ring neighborhood. */
-  AttributeSet &attributes = (subdivision) ? mesh->subd_attributes : mesh->attributes;
+  });
+  /* STEP 5: Blur vertices to approximate 2 ring neighborhood. */
   Attribute *attr = attributes.add(ATTR_STD_POINTINESS);
   float *data = attr->data_float();
-  memcpy(data, &raw_data[0], sizeof(float) * raw_data.size());
-  memset(&counter[0], 0, sizeof(int) * counter.size());
-  edge_index = 0;
-  visited_edges.clear();
-  for (b_mesh.edges.begin(e); e != b_mesh.edges.end(); ++e, ++edge_index) {
-    const int v0 = vert_orig_index[b_mesh.edges[edge_index].vertices()[0]],
-              v1 = vert_orig_index[b_mesh.edges[edge_index].vertices()[1]];
-    if (visited_edges.exists(v0, v1)) {
-      continue;
+  parallel_for_range(num_verts, [&](int start, int end) {
+    for (int vert_index = start; vert_index < end; ++vert_index) {
+      const int count = adjacency_count[vert_index];
+      const int *row = (count) ? &adjacency[adjacency_start[vert_index]] : NULL;
+      float sum = raw_data[vert_index];
+      for (int i = 0; i < count; i++) {
+        sum += raw_data[row[i]];
+      }
+      data[vert_index] = sum / (count + 1);
     }
-    visited_edges.insert(v0, v1);
-    data[v0] += raw_data[v1];
-    data[v1] += raw_data[v0];
-    ++counter[v0];
-    ++counter[v1];
-  }
-  for (int vert_index = 0; vert_index < num_verts; ++vert_index) {
-    data[vert_index] /= counter[vert_index] + 1;
-  }
-  /* STEP 4: Copy attribute to the duplicated vertices. */
+  });
+  /* STEP 6: Copy attribute to the duplicated vertices. */
   for (int vert_index = 0; vert_index < num_verts; ++vert_index) {
     const int orig_index = vert_orig_index[vert_index];
     data[vert_index] = data[orig_index];
   }
 }
 
+/* Union-find that can be joined from many threads at once. Roots are always
+ * linked below the smaller index, so every set ends up with its minimum
+ * element as root, independent of the order the joins happened in. */
+class ConcurrentDisjointSet {
+ public:
+  explicit ConcurrentDisjointSet(int size) : parents_(size)
+  {
+    parallel_for_range(size, [&](int start, int end) {
+      for (int i = start; i < end; i++) {
+        parents_[i].store(i, std::memory_order_relaxed);
+      }
+    });
+  }
+
+  int find(int x)
+  {
+    while (true) {
+      int parent = parents_[x].load(std::memory_order_relaxed);
+      if (parent == x) {
+        return x;
+      }
+
+      /* Path halving, point x to its grandparent. Failing is harmless, some
+       * other thread moved it closer to the root already. */
+      const int grandparent = parents_[parent].load(std::memory_order_relaxed);
+      if (parent != grandparent) {
+        parents_[x].compare_exchange_weak(parent, grandparent, std::memory_order_relaxed);
+      }
+      x = grandparent;
+    }
+  }
+
+  void join(int x, int y)
+  {
+    while (true) {
+      x = find(x);
+      y = find(y);
+      if (x == y) {
+        return;
+      }
+      if (x < y) {
+        swap(x, y);
+      }
+
+      /* Only succeeds while x is still a root, otherwise retry from the new
+       * roots. */
+      int expected = x;
+      if (parents_[x].compare_exchange_strong(expected, y, std::memory_order_relaxed)) {
+        return;
+      }
+    }
+  }
+
+ private:
+  vector<std::atomic<int>> parents_;
+};
+
 /* The Random Per Island attribute is a random float associated with each
  * connected component (island) of the mesh. The attribute is computed by
  * first classifying the vertices into different sets using a Disjoint Set
@@ -674,7 +898,9 @@ static void attr_create_random_per_island(Scene *scene,
                                           BL::Mesh &b_mesh,
                                           bool subdivision)
 {
-  if (!mesh->need_attribute(scene, ATTR_STD_RANDOM_PER_ISLAND)) {
+  AttributeSet &attributes = (subdivision) ? mesh->subd_attributes : mesh->attributes;
+  if (!mesh->need_attribute(scene, ATTR_STD_RANDOM_PER_ISLAND) ||
+      attributes.find(ATTR_STD_RANDOM_PER_ISLAND)) {
     return;
   }
 
@@ -683,29 +909,109 @@ static void attr_create_random_per_island(Scene *scene,
     return;
   }
 
-  DisjointSet vertices_sets(number_of_vertices);
+  ConcurrentDisjointSet vertices_sets(number_of_vertices);
 
-  BL::Mesh::edges_iterator e;
-  for (b_mesh.edges.begin(e); e != b_mesh.edges.end(); ++e) {
-    vertices_sets.join(e->vertices()[0], e->vertices()[1]);
+  const int num_edges = b_mesh.edges.length();
+  if (num_edges) {
+    const MEdge *b_edges = (const MEdge *)b_mesh.edges[0].ptr.data;
+
+    parallel_for_range(num_edges, [&](int start, int end) {
+      for (int i = start; i < end; i++) {
+        vertices_sets.join(b_edges[i].v1, b_edges[i].v2);
+      }
+    });
   }
 
-  AttributeSet &attributes = (subdivision) ? mesh->subd_attributes : mesh->attributes;
   Attribute *attribute = attributes.add(ATTR_STD_RANDOM_PER_ISLAND);
   float *data = attribute->data_float();
 
+  const int num_faces = (!subdivision) ? b_mesh.loop_triangles.length() :
+                                         b_mesh.polygons.length();
+  if (num_faces == 0) {
+    return;
+  }
+
+  const MLoop *b_loops = (const MLoop *)b_mesh.loops[0].ptr.data;
+
   if (!subdivision) {
-    BL::Mesh::loop_triangles_iterator t;
-    for (b_mesh.loop_triangles.begin(t); t != b_mesh.loop_triangles.end(); ++t) {
-      data[t->index()] = hash_uint_to_float(vertices_sets.find(t->vertices()[0]));
-    }
+    const MLoopTri *b_looptris = (const MLoopTri *)b_mesh.loop_triangles[0].ptr.data;
+
+    parallel_for_range(num_faces, [&](int start, int end) {
+      for (int i = start; i < end; i++) {
+        const int vert_index = b_loops[b_looptris[i].tri[0]].v;
+        data[i] = hash_uint_to_float(vertices_sets.find(vert_index));
+      }
+    });
   }
   else {
-    BL::Mesh::polygons_iterator p;
-    for (b_mesh.polygons.begin(p); p != b_mesh.polygons.end(); ++p) {
-      data[p->index()] = hash_uint_to_float(vertices_sets.find(p->vertices()[0]));
+    const MPoly *b_polys = (const MPoly *)b_mesh.polygons[0].ptr.data;
+
+    parallel_for_range(num_faces, [&](int start, int end) {
+      for (int i = start; i < end; i++) {
+        const int vert_index = b_loops[b_polys[i].loopstart].v;
+        data[i] = hash_uint_to_float(vertices_sets.find(vert_index));
+      }
+    });
+  }
+}
+
+/* Create all attributes needed by shaders that are not on the mesh yet.
+ * The calculate functions will check whether they're needed or not, and skip
+ * attributes that already exist. After a full sync the mesh is cleared so
+ * everything is computed, when only the shaders changed this computes just
+ * the newly requested attributes. */
+static void create_mesh_attributes(
+    Scene *scene, Mesh *mesh, BL::Mesh &b_mesh, bool subdivision, bool subdivide_uvs)
+{
+  AttributeSet &attributes = (subdivision) ? mesh->subd_attributes : mesh->attributes;
+
+  /* create generated coordinates from undeformed coordinates */
+  const bool need_generated = mesh->need_attribute(scene, ATTR_STD_GENERATED) ||
+                              ((subdivision == false) && (b_mesh.uv_layers.length() == 0) &&
+                               need_default_tangent(scene, mesh, attributes));
+  if (need_generated && !attributes.find(ATTR_STD_GENERATED)) {
+    Attribute *attr = attributes.add(ATTR_STD_GENERATED);
+    attr->flags |= ATTR_SUBDIVIDED;
+
+    float3 loc, size;
+    mesh_texture_space(b_mesh, loc, size);
+
+    BL::Mesh::vertices_iterator v;
+    float3 *generated = attr->data_float3();
+    size_t i = 0;
+
+    for (b_mesh.vertices.begin(v); v != b_mesh.vertices.end(); ++v) {
+      generated[i++] = get_float3(v->undeformed_co()) * size - loc;
     }
   }
+
+  vector<int> corner_loops;
+  mesh_corner_loops(b_mesh, subdivision, corner_loops);
+
+  attr_create_pointiness(scene, mesh, b_mesh, subdivision);
+  attr_create_vertex_color(scene, mesh, b_mesh, corner_loops, subdivision);
+  attr_create_random_per_island(scene, mesh, b_mesh, subdivision);
+
+  if (subdivision) {
+    attr_create_subd_uv_map(scene, mesh, b_mesh, corner_loops, subdivide_uvs);
+  }
+  else {
+    attr_create_uv_map(scene, mesh, b_mesh, corner_loops);
+  }
+
+  /* For volume objects, create a matrix to transform from object space to
+   * mesh texture space. this does not work with deformations but that can
+   * probably only be done well with a volume grid mapping of coordinates. */
+  if (mesh->need_attribute(scene, ATTR_STD_GENERATED_TRANSFORM) &&
+      !mesh->attributes.find(ATTR_STD_GENERATED_TRANSFORM)) {
+    Attribute *attr = mesh->attributes.add(ATTR_STD_GENERATED_TRANSFORM);
+    Transform *tfm = attr->data_transform();
+
+    float3 loc, size;
+    mesh_texture_space(b_mesh, loc, size);
+
+    *tfm = transform_translate(-loc) * transform_scale(size);
+  }
 }
 
 /* Create Mesh */
@@ -743,64 +1049,59 @@ static void create_mesh(Scene *scene,
   }
 
   /* allocate memory */
-  mesh->reserve_mesh(numverts, numtris);
+  mesh->resize_mesh(numverts, numtris);
   mesh->reserve_subd_faces(numfaces, numngons, numcorners);
 
-  /* create vertex coordinates and normals */
-  BL::Mesh::vertices_iterator v;
-  for (b_mesh.vertices.begin(v); v != b_mesh.vertices.end(); ++v)
-    mesh->add_vertex(get_float3(v->co()));
+  /* create vertex coordinates and normals
+   *
+   * Read the DNA arrays directly, going through RNA for every element is
+   * several function calls per vertex and dominates export of dense meshes. */
+  const MVert *b_verts = (const MVert *)b_mesh.vertices[0].ptr.data;
 
   AttributeSet &attributes = (subdivision) ? mesh->subd_attributes : mesh->attributes;
   Attribute *attr_N = attributes.add(ATTR_STD_VERTEX_NORMAL);
   float3 *N = attr_N->data_float3();
 
-  for (b_mesh.vertices.begin(v); v != b_mesh.vertices.end(); ++v, ++N)
-    *N = get_float3(v->normal());
-  N = attr_N->data_float3();
-
-  /* create generated coordinates from undeformed coordinates */
-  const bool need_default_tangent = (subdivision == false) && (b_mesh.uv_layers.length() == 0) &&
-                                    (mesh->need_attribute(scene, ATTR_STD_UV_TANGENT));
-  if (mesh->need_attribute(scene, ATTR_STD_GENERATED) || need_default_tangent) {
-    Attribute *attr = attributes.add(ATTR_STD_GENERATED);
-    attr->flags |= ATTR_SUBDIVIDED;
-
-    float3 loc, size;
-    mesh_texture_space(b_mesh, loc, size);
-
-    float3 *generated = attr->data_float3();
-    size_t i = 0;
-
-    for (b_mesh.vertices.begin(v); v != b_mesh.vertices.end(); ++v) {
-      generated[i++] = get_float3(v->undeformed_co()) * size - loc;
-    }
+  for (int i = 0; i < numverts; i++) {
+    const MVert &b_vert = b_verts[i];
+    mesh->verts[i] = make_float3(b_vert.co[0], b_vert.co[1], b_vert.co[2]);
+    N[i] = make_float3(b_vert.no[0], b_vert.no[1], b_vert.no[2]) * (1.0f / 32767.0f);
   }
 
   /* create faces */
   if (!subdivision) {
-    BL::Mesh::loop_triangles_iterator t;
+    const MLoopTri *b_looptris = (const MLoopTri *)b_mesh.loop_triangles[0].ptr.data;
+    const MLoop *b_loops = (const MLoop *)b_mesh.loops[0].ptr.data;
+    const MPoly *b_polys = (const MPoly *)b_mesh.polygons[0].ptr.data;
+    int *triangles = mesh->triangles.data();
+
+    /* Create triangles.
+     *
+     * NOTE: Autosmooth is already taken care about.
+     */
+    for (int i = 0; i < numtris; i++) {
+      const MLoopTri &b_looptri = b_looptris[i];
+      const MPoly &b_poly = b_polys[b_looptri.poly];
 
-    for (b_mesh.loop_triangles.begin(t); t != b_mesh.loop_triangles.end(); ++t) {
-      BL::MeshPolygon p = b_mesh.polygons[t->polygon_index()];
-      int3 vi = get_int3(t->vertices());
+      for (int j = 0; j < 3; j++) {
+        triangles[i * 3 + j] = b_loops[b_looptri.tri[j]].v;
+      }
 
-      int shader = clamp(p.material_index(), 0, used_shaders.size() - 1);
-      bool smooth = p.use_smooth() || use_loop_normals;
+      mesh->shader[i] = clamp(b_poly.mat_nr, 0, used_shaders.size() - 1);
+      mesh->smooth[i] = (b_poly.flag & ME_SMOOTH) || use_loop_normals;
+    }
+
+    if (use_loop_normals) {
+      BL::Mesh::loop_triangles_iterator t;
 
-      if (use_loop_normals) {
+      for (b_mesh.loop_triangles.begin(t); t != b_mesh.loop_triangles.end(); ++t) {
+        int3 vi = get_int3(t->vertices());
         BL::Array<float, 9> loop_normals = t->split_normals();
         for (int i = 0; i < 3; i++) {
           N[vi[i]] = make_float3(
               loop_normals[i * 3], loop_normals[i * 3 + 1], loop_normals[i * 3 + 2]);
         }
       }
-
-      /* Create triangles.
-       *
-       * NOTE: Autosmooth is already taken care about.
-       */
-      mesh->add_triangle(vi[0], vi[1], vi[2], shader, smooth);
     }
   }
   else {
@@ -823,32 +1124,7 @@ static void create_mesh(Scene *scene,
     }
   }
 
-  /* Create all needed attributes.
-   * The calculate functions will check whether they're needed or not.
-   */
-  attr_create_pointiness(scene, mesh, b_mesh, subdivision);
-  attr_create_vertex_color(scene, mesh, b_mesh, subdivision);
-  attr_create_random_per_island(scene, mesh, b_mesh, subdivision);
-
-  if (subdivision) {
-    attr_create_subd_uv_map(scene, mesh, b_mesh, subdivide_uvs);
-  }
-  else {
-    attr_create_uv_map(scene, mesh, b_mesh);
-  }
-
-  /* For volume objects, create a matrix to transform from object space to
-   * mesh texture space. this does not work with deformations but that can
-   * probably only be done well with a volume grid mapping of coordinates. */
-  if (mesh->need_attribute(scene, ATTR_STD_GENERATED_TRANSFORM)) {
-    Attribute *attr = mesh->attributes.add(ATTR_STD_GENERATED_TRANSFORM);
-    Transform *tfm = attr->data_transform();
-
-    float3 loc, size;
-    mesh_texture_space(b_mesh, loc, size);
-
-    *tfm = transform_translate(-loc) * transform_scale(size);
-  }
+  create_mesh_attributes(scene, mesh, b_mesh, subdivision, subdivide_uvs);
 }
 
 static void create_subd_mesh(Scene *scene,
@@ -992,6 +1268,43 @@ void BlenderSync::sync_mesh(BL::Depsgraph b_depsgraph,
   mesh->tag_update(scene, rebuild);
 }
 
+bool BlenderSync::sync_mesh_attributes(BL::Depsgraph b_depsgraph, BL::Object b_ob, Mesh *mesh)
+{
+  /* Subdivision meshes are diced from the control mesh and meshes with the
+   * transform applied hold world space data, resync those fully. */
+  if (!view_layer.use_surfaces || mesh->subdivision_type != Mesh::SUBDIVISION_NONE ||
+      mesh->transform_applied) {
+    return false;
+  }
+
+  bool need_undeformed = mesh->need_attribute(scene, ATTR_STD_GENERATED) &&
+                         !mesh->attributes.find(ATTR_STD_GENERATED);
+  BL::Mesh b_mesh = object_to_mesh(
+      b_data, b_ob, b_depsgraph, need_undeformed, Mesh::SUBDIVISION_NONE);
+
+  if (!b_mesh) {
+    return false;
+  }
+
+  /* Data was not tagged for recalc, still check the topology matches before
+   * writing corner attributes for it. */
+  const bool topology_matches = ((size_t)b_mesh.vertices.length() == mesh->verts.size()) &&
+                                ((size_t)b_mesh.loop_triangles.length() == mesh->num_triangles());
+
+  if (topology_matches) {
+    create_mesh_attributes(scene, mesh, b_mesh, false, false);
+  }
+
+  free_object_to_mesh(b_data, b_ob, b_mesh);
+
+  if (!topology_matches) {
+    return false;
+  }
+
+  mesh->tag_update(scene, false);
+  return true;
+}
+
 void BlenderSync::sync_mesh_motion(BL::Depsgraph b_depsgraph,
                                    BL::Object b_ob,
                                    Mesh *mesh,
@@ -1009,6 +1322,16 @@ void BlenderSync::sync_mesh_motion(BL::Depsgraph b_depsgraph,
     return;
   }
 
+  /* Only read from the depsgraph here, the geometry itself may still be
+   * written by the tasks of the previous step. */
+  MotionSnapshot &snapshot = motion_snapshots[motion_snapshot_index];
+  MeshMotionStep step;
+  step.mesh = mesh;
+  step.motion_step = motion_step;
+  step.deformed = false;
+  step.num_verts = 0;
+  step.offset = snapshot.P.size();
+
   /* Skip objects without deforming modifiers. this is not totally reliable,
    * would need a more extensive check to see which objects are animated. */
   BL::Mesh b_mesh(PointerRNA_NULL);
@@ -1019,78 +1342,103 @@ void BlenderSync::sync_mesh_motion(BL::Depsgraph b_depsgraph,
 
   /* TODO(sergey): Perform preliminary check for number of vertices. */
   if (b_mesh) {
-    /* Export deformed coordinates. */
-    /* Find attributes. */
-    Attribute *attr_mP = mesh->attributes.find(ATTR_STD_MOTION_VERTEX_POSITION);
-    Attribute *attr_mN = mesh->attributes.find(ATTR_STD_MOTION_VERTEX_NORMAL);
-    Attribute *attr_N = mesh->attributes.find(ATTR_STD_VERTEX_NORMAL);
-    bool new_attribute = false;
-    /* Add new attributes if they don't exist already. */
-    if (!attr_mP) {
-      attr_mP = mesh->attributes.add(ATTR_STD_MOTION_VERTEX_POSITION);
-      if (attr_N)
-        attr_mN = mesh->attributes.add(ATTR_STD_MOTION_VERTEX_NORMAL);
-
-      new_attribute = true;
+    step.deformed = true;
+    step.num_verts = b_mesh.vertices.length();
+    step.name = b_ob.name();
+
+    /* Coordinates of a mesh with different topology are discarded anyway. */
+    if (step.num_verts == numverts) {
+      const MVert *b_verts = (const MVert *)b_mesh.vertices[0].ptr.data;
+      snapshot.P.resize(step.offset + numverts);
+      snapshot.N.resize(step.offset + numverts);
+      float3 *P = &snapshot.P[step.offset];
+      float3 *N = &snapshot.N[step.offset];
+      for (size_t i = 0; i < numverts; i++) {
+        const MVert &b_vert = b_verts[i];
+        P[i] = make_float3(b_vert.co[0], b_vert.co[1], b_vert.co[2]);
+        N[i] = make_float3(b_vert.no[0], b_vert.no[1], b_vert.no[2]) * (1.0f / 32767.0f);
+      }
     }
-    /* Load vertex data from mesh. */
-    float3 *mP = attr_mP->data_float3() + motion_step * numverts;
-    float3 *mN = (attr_mN) ? attr_mN->data_float3() + motion_step * numverts : NULL;
-    /* NOTE: We don't copy more that existing amount of vertices to prevent
-     * possible memory corruption.
-     */
-    BL::Mesh::vertices_iterator v;
-    int i = 0;
-    for (b_mesh.vertices.begin(v); v != b_mesh.vertices.end() && i < numverts; ++v, ++i) {
-      mP[i] = get_float3(v->co());
-      if (mN)
-        mN[i] = get_float3(v->normal());
+
+    free_object_to_mesh(b_data, b_ob, b_mesh);
+  }
+
+  snapshot.meshes.push_back(step);
+}
+
+void BlenderSync::sync_mesh_motion_step(const MotionSnapshot &snapshot,
+                                        const MeshMotionStep &step)
+{
+  Mesh *mesh = step.mesh;
+  const int motion_step = step.motion_step;
+
+  if (!step.deformed) {
+    /* No deformation on this frame, copy coordinates if other frames did have it. */
+    mesh->copy_center_to_motion_step(motion_step);
+    return;
+  }
+
+  /* Export deformed coordinates. */
+  size_t numverts = mesh->verts.size();
+  const bool same_topology = (step.num_verts == numverts);
+  /* Find attributes. */
+  Attribute *attr_mP = mesh->attributes.find(ATTR_STD_MOTION_VERTEX_POSITION);
+  Attribute *attr_mN = mesh->attributes.find(ATTR_STD_MOTION_VERTEX_NORMAL);
+  Attribute *attr_N = mesh->attributes.find(ATTR_STD_VERTEX_NORMAL);
+  bool new_attribute = false;
+  /* Add new attributes if they don't exist already. */
+  if (!attr_mP) {
+    attr_mP = mesh->attributes.add(ATTR_STD_MOTION_VERTEX_POSITION);
+    if (attr_N)
+      attr_mN = mesh->attributes.add(ATTR_STD_MOTION_VERTEX_NORMAL);
+
+    new_attribute = true;
+  }
+  /* Load vertex data from the snapshot. */
+  float3 *mP = attr_mP->data_float3() + motion_step * numverts;
+  float3 *mN = (attr_mN) ? attr_mN->data_float3() + motion_step * numverts : NULL;
+  if (same_topology) {
+    memcpy(mP, &snapshot.P[step.offset], sizeof(float3) * numverts);
+    if (mN)
+      memcpy(mN, &snapshot.N[step.offset], sizeof(float3) * numverts);
+  }
+  if (new_attribute) {
+    /* In case of new attribute, we verify if there really was any motion. */
+    if (!same_topology || memcmp(mP, &mesh->verts[0], sizeof(float3) * numverts) == 0) {
+      /* no motion, remove attributes again */
+      if (!same_topology) {
+        VLOG(1) << "Topology differs, disabling motion blur for object " << step.name;
+      }
+      else {
+        VLOG(1) << "No actual deformation motion for object " << step.name;
+      }
+      mesh->attributes.remove(ATTR_STD_MOTION_VERTEX_POSITION);
+      if (attr_mN)
+        mesh->attributes.remove(ATTR_STD_MOTION_VERTEX_NORMAL);
     }
-    if (new_attribute) {
-      /* In case of new attribute, we verify if there really was any motion. */
-      if (b_mesh.vertices.length() != numverts ||
-          memcmp(mP, &mesh->verts[0], sizeof(float3) * numverts) == 0) {
-        /* no motion, remove attributes again */
-        if (b_mesh.vertices.length() != numverts) {
-          VLOG(1) << "Topology differs, disabling motion blur for object " << b_ob.name();
-        }
-        else {
-          VLOG(1) << "No actual deformation motion for object " << b_ob.name();
-        }
-        mesh->attributes.remove(ATTR_STD_MOTION_VERTEX_POSITION);
+    else if (motion_step > 0) {
+      VLOG(1) << "Filling deformation motion for object " << step.name;
+      /* motion, fill up previous steps that we might have skipped because
+       * they had no motion, but we need them anyway now */
+      float3 *P = &mesh->verts[0];
+      float3 *N = (attr_N) ? attr_N->data_float3() : NULL;
+      for (int prev = 0; prev < motion_step; prev++) {
+        memcpy(attr_mP->data_float3() + prev * numverts, P, sizeof(float3) * numverts);
         if (attr_mN)
-          mesh->attributes.remove(ATTR_STD_MOTION_VERTEX_NORMAL);
-      }
-      else if (motion_step > 0) {
-        VLOG(1) << "Filling deformation motion for object " << b_ob.name();
-        /* motion, fill up previous steps that we might have skipped because
-         * they had no motion, but we need them anyway now */
-        float3 *P = &mesh->verts[0];
-        float3 *N = (attr_N) ? attr_N->data_float3() : NULL;
-        for (int step = 0; step < motion_step; step++) {
-          memcpy(attr_mP->data_float3() + step * numverts, P, sizeof(float3) * numverts);
-          if (attr_mN)
-            memcpy(attr_mN->data_float3() + step * numverts, N, sizeof(float3) * numverts);
-        }
+          memcpy(attr_mN->data_float3() + prev * numverts, N, sizeof(float3) * numverts);
       }
     }
-    else {
-      if (b_mesh.vertices.length() != numverts) {
-        VLOG(1) << "Topology differs, discarding motion blur for object " << b_ob.name()
-                << " at time " << motion_step;
-        memcpy(mP, &mesh->verts[0], sizeof(float3) * numverts);
-        if (mN != NULL) {
-          memcpy(mN, attr_N->data_float3(), sizeof(float3) * numverts);
-        }
+  }
+  else {
+    if (!same_topology) {
+      VLOG(1) << "Topology differs, discarding motion blur for object " << step.name
+              << " at time " << motion_step;
+      memcpy(mP, &mesh->verts[0], sizeof(float3) * numverts);
+      if (mN != NULL) {
+        memcpy(mN, attr_N->data_float3(), sizeof(float3) * numverts);
       }
     }
-
-    free_object_to_mesh(b_data, b_ob, b_mesh);
-    return;
   }
-
-  /* No deformation on this frame, copy coordinates if other frames did have it. */
-  mesh->copy_center_to_motion_step(motion_step);
 }
 
 CCL_NAMESPACE_END
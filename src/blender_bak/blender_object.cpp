@@ -106,7 +106,7 @@ Object *BlenderSync::sync_object(BL::Depsgraph &b_depsgraph,
                                  float motion_time,
                                  bool use_particle_hair,
                                  bool show_lights,
-                                 BlenderObjectCulling &culling,
+                                 bool culled,
                                  bool *use_portal)
 {
   const bool is_instance = b_instance.is_instance();
@@ -152,7 +152,7 @@ Object *BlenderSync::sync_object(BL::Depsgraph &b_depsgraph,
   }
 
   /* Perform object culling. */
-  if (culling.test(scene, b_ob, tfm)) {
+  if (culled) {
     return NULL;
   }
 
@@ -323,6 +323,58 @@ Object *BlenderSync::sync_object(BL::Depsgraph &b_depsgraph,
   return object;
 }
 
+/* Object Culling
+ *
+ * The depsgraph iterator hands out a temporary object for every dupli and
+ * reuses it on the next step, so instances can not be kept around until a
+ * batch is full. Instead the bounds and transforms of all visible mesh
+ * instances are gathered in a first pass over the depsgraph and culled in SoA
+ * batches, four at a time with SSE. The object loop then walks the depsgraph
+ * again, which yields the instances in the same order, and picks up the
+ * result by index. Only done when culling is enabled for the scene. */
+
+void BlenderSync::cull_objects(BL::Depsgraph &b_depsgraph,
+                               BL::SpaceView3D &b_v3d,
+                               BlenderObjectCulling &culling,
+                               vector<bool> &culled)
+{
+  BlenderObjectCullingBatch batch;
+  vector<size_t> batch_instance;
+
+  BL::Depsgraph::object_instances_iterator b_instance_iter;
+  for (b_depsgraph.object_instances.begin(b_instance_iter);
+       b_instance_iter != b_depsgraph.object_instances.end();
+       ++b_instance_iter) {
+    BL::DepsgraphObjectInstance b_instance = *b_instance_iter;
+    BL::Object b_ob = b_instance.object();
+
+    /* Same visibility test as the object loop, which counts instances. */
+    const bool show_in_viewport = !b_v3d || b_ob.visible_in_viewport_get(b_v3d);
+    if (show_in_viewport == false) {
+      continue;
+    }
+
+    const size_t index = culled.size();
+    culled.push_back(false);
+
+    /* Lights and other objects without meshes are never culled. */
+    if (!object_is_mesh(b_ob)) {
+      continue;
+    }
+
+    culling.init_object(scene, b_ob);
+    if (culling.add(batch, b_ob, get_transform(b_ob.matrix_world()))) {
+      batch_instance.push_back(index);
+    }
+  }
+
+  array<bool> batch_culled;
+  culling.test(batch, batch_culled);
+  for (size_t i = 0; i < batch_instance.size(); i++) {
+    culled[batch_instance[i]] = batch_culled[i];
+  }
+}
+
 /* Object Loop */
 
 void BlenderSync::sync_objects(BL::Depsgraph &b_depsgraph,
@@ -346,6 +398,11 @@ void BlenderSync::sync_objects(BL::Depsgraph &b_depsgraph,
 
   /* initialize culling */
   BlenderObjectCulling culling(scene, b_scene);
+  vector<bool> culled;
+  if (culling.enabled()) {
+    cull_objects(b_depsgraph, b_v3d, culling, culled);
+  }
+  size_t instance_index = 0;
 
   /* object loop */
   bool cancel = false;
@@ -367,8 +424,9 @@ void BlenderSync::sync_objects(BL::Depsgraph &b_depsgraph,
       continue;
     }
 
-    /* Load per-object culling data. */
-    culling.init_object(scene, b_ob);
+    /* Culling result, in the same iteration order. */
+    const bool is_culled = instance_index < culled.size() && culled[instance_index];
+    instance_index++;
 
     /* Object itself. */
     if (b_instance.show_self()) {
@@ -378,7 +436,7 @@ void BlenderSync::sync_objects(BL::Depsgraph &b_depsgraph,
                   motion_time,
                   false,
                   show_lights,
-                  culling,
+                  is_culled,
                   &use_portal);
     }
 
@@ -390,13 +448,35 @@ void BlenderSync::sync_objects(BL::Depsgraph &b_depsgraph,
                   motion_time,
                   true,
                   show_lights,
-                  culling,
+                  is_culled,
                   &use_portal);
     }
 
     cancel = progress.get_cancel();
   }
 
+  /* Convert the unique geometry found by the object loop. The loop itself has
+   * to stay serial as it walks the depsgraph iterator, but each geometry is
+   * independent from there on. */
+  if (!cancel) {
+    sync_geometry_queue();
+    cancel = progress.get_cancel();
+  }
+  else {
+    geometry_sync_queue.clear();
+  }
+
+  /* Deformation motion is written by tasks that keep running while the caller
+   * sets the next frame, only the depsgraph reads above have to be serial. */
+  if (motion) {
+    if (!cancel) {
+      sync_geometry_motion_queue();
+    }
+    else {
+      sync_geometry_motion_wait();
+    }
+  }
+
   progress.set_sync_status("");
 
   if (!cancel && !motion) {
@@ -503,6 +583,9 @@ void BlenderSync::sync_motion(BL::RenderSettings &b_render,
   b_engine.frame_set(frame_center, subframe_center);
   python_thread_state_save(python_thread_state);
 
+  /* The last motion step may still be writing geometry. */
+  sync_geometry_motion_wait();
+
   /* tag camera for motion update */
   if (scene->camera->motion_modified(prevcam))
     scene->camera->tag_update();
@@ -29,7 +29,8 @@ BlenderObjectCulling::BlenderObjectCulling(Scene *scene, BL::Scene &b_scene)
       camera_cull_margin_(0.0f),
       use_scene_distance_cull_(false),
       use_distance_cull_(false),
-      distance_cull_margin_(0.0f)
+      distance_cull_margin_(0.0f),
+      planes_initialized_(false)
 {
   if (b_scene.render().use_simplify()) {
     PointerRNA cscene = RNA_pointer_get(&b_scene.ptr, "cycles");
@@ -61,82 +62,238 @@ void BlenderObjectCulling::init_object(Scene *scene, BL::Object &b_ob)
   use_camera_cull_ = use_scene_camera_cull_ && get_boolean(cobject, "use_camera_cull");
   use_distance_cull_ = use_scene_distance_cull_ && get_boolean(cobject, "use_distance_cull");
 
-  if (use_camera_cull_ || use_distance_cull_) {
+  if ((use_camera_cull_ || use_distance_cull_) && !planes_initialized_) {
     /* Need to have proper projection matrix. */
     scene->camera->update(scene);
+    init_planes(scene);
   }
 }
 
-bool BlenderObjectCulling::test(Scene *scene, BL::Object &b_ob, Transform &tfm)
+void BlenderObjectCulling::init_planes(Scene *scene)
+{
+  Camera *cam = scene->camera;
+  const ProjectionTransform &worldtondc = cam->worldtondc;
+  const float4 margin = make_float4(0.0f, 0.0f, 0.0f, camera_cull_margin_);
+
+  /* Outside of the screen in NDC x and y, with the margin, and behind the
+   * camera. In homogeneous coordinates, so the planes are valid in front of
+   * the camera as well as behind it. */
+  planes_[0] = worldtondc.x - (1.0f + camera_cull_margin_) * worldtondc.w;
+  planes_[1] = -worldtondc.x - camera_cull_margin_ * worldtondc.w;
+  planes_[2] = worldtondc.y - (1.0f + camera_cull_margin_) * worldtondc.w;
+  planes_[3] = -worldtondc.y - camera_cull_margin_ * worldtondc.w;
+  planes_[4] = -worldtondc.z - margin;
+
+  camera_position_ = transform_get_column(&cam->matrix, 3);
+
+  /* Directions of the four frustum edges, from the side planes around them.
+   * Only perspective frustums start at a single point. */
+  const float3 view_dir = transform_get_column(&cam->matrix, 2);
+  const int edges[4][2] = {{0, 2}, {2, 1}, {1, 3}, {3, 0}};
+  float3 edge_dir[4];
+
+  for (int i = 0; i < 4; i++) {
+    edge_dir[i] = cross(float4_to_float3(planes_[edges[i][0]]),
+                        float4_to_float3(planes_[edges[i][1]]));
+    if (dot(edge_dir[i], view_dir) < 0.0f) {
+      edge_dir[i] = -edge_dir[i];
+    }
+  }
+
+  for (int axis = 0; axis < 3; axis++) {
+    frustum_positive_[axis] = cam->type == CAMERA_PERSPECTIVE;
+    frustum_negative_[axis] = cam->type == CAMERA_PERSPECTIVE;
+    for (int i = 0; i < 4; i++) {
+      frustum_positive_[axis] = frustum_positive_[axis] && edge_dir[i][axis] >= 0.0f;
+      frustum_negative_[axis] = frustum_negative_[axis] && edge_dir[i][axis] <= 0.0f;
+    }
+  }
+
+  planes_initialized_ = true;
+}
+
+bool BlenderObjectCulling::add(BlenderObjectCullingBatch &batch,
+                               BL::Object &b_ob,
+                               const Transform &tfm)
 {
   if (!use_camera_cull_ && !use_distance_cull_) {
     return false;
   }
 
-  /* Compute world space bounding box corners. */
-  float3 bb[8];
+  /* Object space bounding box. */
+  float3 bb_min = make_float3(FLT_MAX, FLT_MAX, FLT_MAX),
+         bb_max = make_float3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
   BL::Array<float, 24> boundbox = b_ob.bound_box();
   for (int i = 0; i < 8; ++i) {
     float3 p = make_float3(boundbox[3 * i + 0], boundbox[3 * i + 1], boundbox[3 * i + 2]);
-    bb[i] = transform_point(&tfm, p);
+    bb_min = min(bb_min, p);
+    bb_max = max(bb_max, p);
   }
 
-  bool camera_culled = use_camera_cull_ && test_camera(scene, bb);
-  bool distance_culled = use_distance_cull_ && test_distance(scene, bb);
+  batch.add(bb_min, bb_max, tfm, use_camera_cull_, use_distance_cull_);
+  return true;
+}
+
+/* Batch */
 
-  return ((camera_culled && distance_culled) || (camera_culled && !use_distance_cull_) ||
-          (distance_culled && !use_camera_cull_));
+void BlenderObjectCullingBatch::clear()
+{
+  for (int i = 0; i < 3; i++) {
+    bb_min[i].clear();
+    bb_max[i].clear();
+  }
+  for (int i = 0; i < 12; i++) {
+    tfm[i].clear();
+  }
+  use_camera_cull.clear();
+  use_distance_cull.clear();
 }
 
-/* TODO(sergey): Not really optimal, consider approaches based on k-DOP in order
- * to reduce number of objects which are wrongly considered visible.
- */
-bool BlenderObjectCulling::test_camera(Scene *scene, float3 bb[8])
+void BlenderObjectCullingBatch::add(const float3 &bb_min_,
+                                    const float3 &bb_max_,
+                                    const Transform &tfm_,
+                                    bool use_camera_cull_,
+                                    bool use_distance_cull_)
 {
-  Camera *cam = scene->camera;
-  const ProjectionTransform &worldtondc = cam->worldtondc;
-  float3 bb_min = make_float3(FLT_MAX, FLT_MAX, FLT_MAX),
-         bb_max = make_float3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
-  bool all_behind = true;
-  for (int i = 0; i < 8; ++i) {
-    float3 p = bb[i];
-    float4 b = make_float4(p.x, p.y, p.z, 1.0f);
-    float4 c = make_float4(
-        dot(worldtondc.x, b), dot(worldtondc.y, b), dot(worldtondc.z, b), dot(worldtondc.w, b));
-    p = float4_to_float3(c / c.w);
-    if (c.z < 0.0f) {
-      p.x = 1.0f - p.x;
-      p.y = 1.0f - p.y;
+  const float *m = &tfm_.x.x;
+
+  for (int i = 0; i < 3; i++) {
+    bb_min[i].push_back_slow(bb_min_[i]);
+    bb_max[i].push_back_slow(bb_max_[i]);
+  }
+  for (int i = 0; i < 12; i++) {
+    tfm[i].push_back_slow(m[i]);
+  }
+  use_camera_cull.push_back_slow(use_camera_cull_);
+  use_distance_cull.push_back_slow(use_distance_cull_);
+}
+
+/* Culling math, shared by the scalar and SSE paths. T is float or ssef, M
+ * the matching comparison result. */
+
+ccl_device_inline float cull_abs(float f)
+{
+  return fabsf(f);
+}
+
+#ifdef __KERNEL_SSE2__
+ccl_device_inline ssef cull_abs(const ssef &f)
+{
+  return abs(f);
+}
+#endif
+
+template<typename T, typename M>
+M BlenderObjectCulling::test_lanes(const T bb_min[3],
+                                   const T bb_max[3],
+                                   const T tfm[12],
+                                   const M &use_camera_cull,
+                                   const M &use_distance_cull)
+{
+  /* World space oriented box, as center and three half axes. */
+  T object_center[3], center[3], axis[3][3], extent[3];
+
+  for (int i = 0; i < 3; i++) {
+    const T half_size = (bb_max[i] - bb_min[i]) * T(0.5f);
+    object_center[i] = (bb_min[i] + bb_max[i]) * T(0.5f);
+    for (int row = 0; row < 3; row++) {
+      axis[i][row] = tfm[row * 4 + i] * half_size;
     }
-    if (c.z >= -camera_cull_margin_) {
-      all_behind = false;
+  }
+
+  for (int row = 0; row < 3; row++) {
+    center[row] = tfm[row * 4 + 0] * object_center[0] + tfm[row * 4 + 1] * object_center[1] +
+                  tfm[row * 4 + 2] * object_center[2] + tfm[row * 4 + 3];
+  }
+
+  /* Half size of the world space axis aligned bounds. */
+  for (int row = 0; row < 3; row++) {
+    extent[row] = cull_abs(axis[0][row]) + cull_abs(axis[1][row]) + cull_abs(axis[2][row]);
+  }
+
+  /* Culled when all box corners are outside one plane. */
+  M camera_culled = M();
+  for (int i = 0; i < 5; i++) {
+    const float4 &plane = planes_[i];
+    const T dist = T(plane.x) * center[0] + T(plane.y) * center[1] + T(plane.z) * center[2] +
+                   T(plane.w);
+    T radius = T(0.0f);
+    for (int j = 0; j < 3; j++) {
+      radius = radius + cull_abs(T(plane.x) * axis[j][0] + T(plane.y) * axis[j][1] +
+                                 T(plane.z) * axis[j][2]);
     }
-    bb_min = min(bb_min, p);
-    bb_max = max(bb_max, p);
+
+    const M outside = (dist - radius >= T(0.0f));
+    camera_culled = (i == 0) ? outside : (camera_culled | outside);
   }
-  if (all_behind) {
-    return true;
+
+  /* Or when the whole frustum is outside one face of the bounds, this
+   * catches large boxes next to frustum edges that no single plane rejects. */
+  for (int row = 0; row < 3; row++) {
+    if (frustum_positive_[row]) {
+      camera_culled = camera_culled | (T(camera_position_[row]) >= center[row] + extent[row]);
+    }
+    if (frustum_negative_[row]) {
+      camera_culled = camera_culled | (T(camera_position_[row]) <= center[row] - extent[row]);
+    }
   }
-  return (bb_min.x >= 1.0f + camera_cull_margin_ || bb_min.y >= 1.0f + camera_cull_margin_ ||
-          bb_max.x <= -camera_cull_margin_ || bb_max.y <= -camera_cull_margin_);
+
+  T dist_sq = T(0.0f);
+  for (int row = 0; row < 3; row++) {
+    const T p = T(camera_position_[row]);
+    const T closest = max(min(center[row] + extent[row], p), center[row] - extent[row]);
+    dist_sq = dist_sq + (p - closest) * (p - closest);
+  }
+  const M distance_culled = (dist_sq > T(distance_cull_margin_ * distance_cull_margin_));
+
+  /* With both enabled an instance has to fail both tests. */
+  return (!use_camera_cull | camera_culled) & (!use_distance_cull | distance_culled) &
+         (use_camera_cull | use_distance_cull);
 }
 
-bool BlenderObjectCulling::test_distance(Scene *scene, float3 bb[8])
+void BlenderObjectCulling::test(const BlenderObjectCullingBatch &batch, array<bool> &culled)
 {
-  float3 camera_position = transform_get_column(&scene->camera->matrix, 3);
-  float3 bb_min = make_float3(FLT_MAX, FLT_MAX, FLT_MAX),
-         bb_max = make_float3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+  const size_t num = batch.size();
+  culled.resize(num);
 
-  /* Find min & max points for x & y & z on bounding box */
-  for (int i = 0; i < 8; ++i) {
-    float3 p = bb[i];
-    bb_min = min(bb_min, p);
-    bb_max = max(bb_max, p);
+  size_t i = 0;
+
+#ifdef __KERNEL_SSE2__
+  for (; i + 4 <= num; i += 4) {
+    ssef bb_min[3], bb_max[3], tfm[12];
+    for (int j = 0; j < 3; j++) {
+      bb_min[j] = ssef(_mm_loadu_ps(&batch.bb_min[j][i]));
+      bb_max[j] = ssef(_mm_loadu_ps(&batch.bb_max[j][i]));
+    }
+    for (int j = 0; j < 12; j++) {
+      tfm[j] = ssef(_mm_loadu_ps(&batch.tfm[j][i]));
+    }
+
+    const bool *cam = &batch.use_camera_cull[i], *dist = &batch.use_distance_cull[i];
+    const sseb use_camera_cull(cam[0], cam[1], cam[2], cam[3]);
+    const sseb use_distance_cull(dist[0], dist[1], dist[2], dist[3]);
+
+    const int mask = movemask(
+        test_lanes<ssef, sseb>(bb_min, bb_max, tfm, use_camera_cull, use_distance_cull));
+    for (int k = 0; k < 4; k++) {
+      culled[i + k] = (mask & (1 << k)) != 0;
+    }
   }
+#endif
 
-  float3 closest_point = max(min(bb_max, camera_position), bb_min);
-  return (len_squared(camera_position - closest_point) >
-          distance_cull_margin_ * distance_cull_margin_);
+  for (; i < num; i++) {
+    float bb_min[3], bb_max[3], tfm[12];
+    for (int j = 0; j < 3; j++) {
+      bb_min[j] = batch.bb_min[j][i];
+      bb_max[j] = batch.bb_max[j][i];
+    }
+    for (int j = 0; j < 12; j++) {
+      tfm[j] = batch.tfm[j][i];
+    }
+
+    culled[i] = test_lanes<float, bool>(
+        bb_min, bb_max, tfm, batch.use_camera_cull[i], batch.use_distance_cull[i]);
+  }
 }
 
 CCL_NAMESPACE_END
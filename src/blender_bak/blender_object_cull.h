@@ -18,22 +18,62 @@
 #define __BLENDER_OBJECT_CULL_H__
 
 #include "blender/blender_sync.h"
+#include "util/util_array.h"
 #include "util/util_types.h"
 
 CCL_NAMESPACE_BEGIN
 
 class Scene;
 
+/* Object space bounds, object to world transforms and culling settings of
+ * instances, as SoA arrays so they can be culled several at a time. tfm holds
+ * the 12 entries of the row major 3x4 transform, each as an array. */
+class BlenderObjectCullingBatch {
+ public:
+  void clear();
+  void add(const float3 &bb_min,
+           const float3 &bb_max,
+           const Transform &tfm,
+           bool use_camera_cull,
+           bool use_distance_cull);
+
+  size_t size() const
+  {
+    return bb_min[0].size();
+  }
+
+  array<float> bb_min[3];
+  array<float> bb_max[3];
+  array<float> tfm[12];
+  array<bool> use_camera_cull;
+  array<bool> use_distance_cull;
+};
+
 class BlenderObjectCulling {
  public:
   BlenderObjectCulling(Scene *scene, BL::Scene &b_scene);
 
+  /* Culling is enabled for the scene, objects may still opt out. */
+  bool enabled() const
+  {
+    return use_scene_camera_cull_ || use_scene_distance_cull_;
+  }
+
   void init_object(Scene *scene, BL::Object &b_ob);
-  bool test(Scene *scene, BL::Object &b_ob, Transform &tfm);
+  /* Add the object given to init_object() to the batch with its settings,
+   * returns false without adding it when culling is disabled for it. */
+  bool add(BlenderObjectCullingBatch &batch, BL::Object &b_ob, const Transform &tfm);
+  /* Test all instances in the batch, culled[i] is set for culled ones. */
+  void test(const BlenderObjectCullingBatch &batch, array<bool> &culled);
 
  private:
-  bool test_camera(Scene *scene, float3 bb[8]);
-  bool test_distance(Scene *scene, float3 bb[8]);
+  void init_planes(Scene *scene);
+  template<typename T, typename M>
+  M test_lanes(const T bb_min[3],
+               const T bb_max[3],
+               const T tfm[12],
+               const M &use_camera_cull,
+               const M &use_distance_cull);
 
   bool use_scene_camera_cull_;
   bool use_camera_cull_;
@@ -41,6 +81,17 @@ class BlenderObjectCulling {
   bool use_scene_distance_cull_;
   bool use_distance_cull_;
   float distance_cull_margin_;
+
+  /* Camera frustum side and near planes in world space, including the cull
+   * margin. A point p is outside when dot(plane, (p, 1)) >= 0. */
+  bool planes_initialized_;
+  float4 planes_[5];
+  float3 camera_position_;
+  /* The infinite frustum lies entirely on the positive (or negative) side of
+   * the camera position along an axis, used to also cull boxes by their own
+   * faces and not only by the frustum planes. */
+  bool frustum_positive_[3];
+  bool frustum_negative_[3];
 };
 
 CCL_NAMESPACE_END
@@ -39,6 +39,7 @@
 #include "util/util_logging.h"
 #include "util/util_murmurhash.h"
 #include "util/util_progress.h"
+#include "util/util_task.h"
 #include "util/util_time.h"
 
 #include "blender/blender_session.h"
@@ -769,8 +770,6 @@ void BlenderSession::do_write_update_render_result(BL::RenderLayer &b_rlay,
 
   float exposure = scene->film->exposure;
 
-  vector<float> pixels(rtile.w * rtile.h * 4);
-
   /* Adjust absolute sample number to the range. */
   int sample = rtile.sample;
   const int range_start_sample = session->tile_manager.range_start_sample;
@@ -778,39 +777,91 @@ void BlenderSession::do_write_update_render_result(BL::RenderLayer &b_rlay,
     sample -= range_start_sample;
   }
 
+  const size_t pass_size = (size_t)rtile.w * rtile.h * 4;
+  vector<float> pixels;
+
   if (!do_update_only) {
-    /* copy each pass */
+    /* Gather passes first, RNA is only accessed from this thread. */
+    struct PassInfo {
+      string name;
+      int components;
+      int denoising_offset;
+    };
+
+    vector<BL::RenderPass> b_passes;
+    vector<PassInfo> passes;
     BL::RenderLayer::passes_iterator b_iter;
 
     for (b_rlay.passes.begin(b_iter); b_iter != b_rlay.passes.end(); ++b_iter) {
       BL::RenderPass b_pass(*b_iter);
-      int components = b_pass.channels();
+      PassInfo pass = {b_pass.name(), b_pass.channels(), BlenderSync::get_denoising_pass(b_pass)};
+      b_passes.push_back(b_pass);
+      passes.push_back(pass);
+    }
+
+    acquire_tile_pixels(pixels, pass_size * passes.size());
+
+    /* Copy each pass into its own part of the scratch memory in parallel. */
+    TaskPool pool;
+
+    for (size_t i = 0; i < passes.size(); i++) {
+      pool.push([&, i]() {
+        const PassInfo &pass = passes[i];
+        float *pass_pixels = &pixels[i * pass_size];
 
-      /* Copy pixels from regular render passes. */
-      bool read = buffers->get_pass_rect(b_pass.name(), exposure, sample, components, &pixels[0]);
+        /* Copy pixels from regular render passes. */
+        bool read = buffers->get_pass_rect(
+            pass.name, exposure, sample, pass.components, pass_pixels);
 
-      /* If denoising pass, */
-      if (!read) {
-        int denoising_offset = BlenderSync::get_denoising_pass(b_pass);
-        if (denoising_offset >= 0) {
+        /* If denoising pass, */
+        if (!read && pass.denoising_offset >= 0) {
           read = buffers->get_denoising_pass_rect(
-              denoising_offset, exposure, sample, components, &pixels[0]);
+              pass.denoising_offset, exposure, sample, pass.components, pass_pixels);
         }
-      }
 
-      if (!read) {
-        memset(&pixels[0], 0, pixels.size() * sizeof(float));
-      }
+        if (!read) {
+          memset(pass_pixels, 0, pass_size * sizeof(float));
+        }
+      });
+    }
+
+    pool.wait_work();
 
-      b_pass.rect(&pixels[0]);
+    /* Hand all passes over to Blender at once. */
+    for (size_t i = 0; i < b_passes.size(); i++) {
+      b_passes[i].rect(&pixels[i * pass_size]);
     }
   }
   else {
     /* copy combined pass */
+    acquire_tile_pixels(pixels, pass_size);
+
     BL::RenderPass b_combined_pass(b_rlay.passes.find_by_name("Combined", b_rview_name.c_str()));
     if (buffers->get_pass_rect("Combined", exposure, sample, 4, &pixels[0]))
       b_combined_pass.rect(&pixels[0]);
   }
+
+  release_tile_pixels(pixels);
+}
+
+void BlenderSession::acquire_tile_pixels(vector<float> &pixels, size_t size)
+{
+  {
+    thread_scoped_lock lock(tile_pixels_mutex);
+    if (!tile_pixels_pool.empty()) {
+      pixels.swap(tile_pixels_pool.back());
+      tile_pixels_pool.pop_back();
+    }
+  }
+
+  pixels.resize(size);
+}
+
+void BlenderSession::release_tile_pixels(vector<float> &pixels)
+{
+  thread_scoped_lock lock(tile_pixels_mutex);
+  tile_pixels_pool.push_back(vector<float>());
+  tile_pixels_pool.back().swap(pixels);
 }
 
 void BlenderSession::write_render_result(BL::RenderLayer &b_rlay, RenderTile &rtile)
@@ -25,6 +25,7 @@
 #include "render/scene.h"
 #include "render/session.h"
 
+#include "util/util_thread.h"
 #include "util/util_vector.h"
 
 CCL_NAMESPACE_BEGIN
@@ -157,6 +158,14 @@ class BlenderSession {
                                      bool do_update_only);
   void do_write_update_render_tile(RenderTile &rtile, bool do_update_only, bool highlight);
 
+  /* Scratch memory for writing tiles back to Blender, kept in a pool so that
+   * tiles written from any thread reuse earlier allocations. */
+  void acquire_tile_pixels(vector<float> &pixels, size_t size);
+  void release_tile_pixels(vector<float> &pixels);
+
+  thread_mutex tile_pixels_mutex;
+  vector<vector<float>> tile_pixels_pool;
+
   void builtin_images_load();
 
   /* Update tile manager to reflect resumable render settings. */
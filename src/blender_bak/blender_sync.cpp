@@ -59,6 +59,7 @@ BlenderSync::BlenderSync(BL::RenderEngine &b_engine,
       geometry_map(&scene->geometry),
       light_map(&scene->lights),
       particle_system_map(&scene->particle_systems),
+      motion_snapshot_index(0),
       world_map(NULL),
       world_recalc(false),
       scene(scene),
@@ -30,6 +30,7 @@
 
 #include "util/util_map.h"
 #include "util/util_set.h"
+#include "util/util_task.h"
 #include "util/util_transform.h"
 #include "util/util_vector.h"
 
@@ -135,8 +136,12 @@ class BlenderSync {
                       float motion_time,
                       bool use_particle_hair,
                       bool show_lights,
-                      BlenderObjectCulling &culling,
+                      bool culled,
                       bool *use_portal);
+  void cull_objects(BL::Depsgraph &b_depsgraph,
+                    BL::SpaceView3D &b_v3d,
+                    BlenderObjectCulling &culling,
+                    vector<bool> &culled);
 
   /* Volume */
   void sync_volume(BL::Object &b_ob, Mesh *mesh, const vector<Shader *> &used_shaders);
@@ -146,7 +151,11 @@ class BlenderSync {
                  BL::Object b_ob,
                  Mesh *mesh,
                  const vector<Shader *> &used_shaders);
+  bool sync_mesh_attributes(BL::Depsgraph b_depsgraph, BL::Object b_ob, Mesh *mesh);
   void sync_mesh_motion(BL::Depsgraph b_depsgraph, BL::Object b_ob, Mesh *mesh, int motion_step);
+  struct MotionSnapshot;
+  struct MeshMotionStep;
+  void sync_mesh_motion_step(const MotionSnapshot &snapshot, const MeshMotionStep &step);
 
   /* Hair */
   void sync_hair(BL::Depsgraph b_depsgraph,
@@ -178,6 +187,9 @@ class BlenderSync {
                             Object *object,
                             float motion_time,
                             bool use_particle_hair);
+  void sync_geometry_queue();
+  void sync_geometry_motion_queue();
+  void sync_geometry_motion_wait();
 
   /* Light */
   void sync_light(BL::Object &b_parent,
@@ -217,7 +229,40 @@ class BlenderSync {
   id_map<ObjectKey, Light> light_map;
   id_map<ParticleSystemKey, ParticleSystem> particle_system_map;
   set<Geometry *> geometry_synced;
+  vector<TaskRunFunction> geometry_sync_queue;
   set<Geometry *> geometry_motion_synced;
+
+  /* Deformed coordinates of one motion step, copied out of the evaluated
+   * meshes so they can be written to the geometry by worker tasks while
+   * the next frame is being evaluated. */
+  struct MeshMotionStep {
+    Mesh *mesh;
+    int motion_step;
+    /* False if the object has no deformation at this step. */
+    bool deformed;
+    size_t num_verts;
+    size_t offset;
+    string name;
+  };
+
+  struct MotionSnapshot {
+    vector<MeshMotionStep> meshes;
+    vector<float3> P;
+    vector<float3> N;
+
+    void clear()
+    {
+      meshes.clear();
+      P.clear();
+      N.clear();
+    }
+  };
+
+  /* Two snapshots alternate between consecutive steps, which bounds the
+   * pipeline to one step in flight while the next one is filled. */
+  MotionSnapshot motion_snapshots[2];
+  int motion_snapshot_index;
+  TaskPool motion_sync_pool;
   set<float> motion_times;
   void *world_map;
   bool world_recalc;
@@ -24,6 +24,7 @@
 #include "util/util_map.h"
 #include "util/util_path.h"
 #include "util/util_set.h"
+#include "util/util_task.h"
 #include "util/util_transform.h"
 #include "util/util_types.h"
 #include "util/util_vector.h"
@@ -610,6 +611,24 @@ static inline uint object_ray_visibility(BL::Object &b_ob)
   return flag;
 }
 
+/* Run func(start, end) over chunks of [0, num) on a task pool. */
+template<typename Func> static inline void parallel_for_range(int num, const Func &func)
+{
+  const int chunk_size = 16384;
+
+  if (num <= chunk_size) {
+    func(0, num);
+    return;
+  }
+
+  TaskPool pool;
+  for (int start = 0; start < num; start += chunk_size) {
+    const int end = min(start + chunk_size, num);
+    pool.push([=, &func]() { func(start, end); });
+  }
+  pool.wait_work();
+}
+
 class EdgeMap {
  public:
   EdgeMap()
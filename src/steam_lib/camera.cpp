@@ -0,0 +1,24 @@
+#include "steam_lib/camera.h"
+
+namespace steam {
+
+Camera::Camera(): matrix(transform_identity()), fov(0.8575f), width(1), height(1), near_clip(1e-4f), far_clip(1e30f) {
+	update();
+}
+
+void Camera::update() {
+	origin_ = transform_get_column(matrix, 3);
+	tan_half_x_ = tanf(fov * 0.5f);
+	tan_half_y_ = tan_half_x_ * (float)height / (float)std::max(width, 1);
+}
+
+void Camera::generate_ray(float x, float y, float3 *P, float3 *D) const {
+	float3 dir = make_float3((2.0f * x / (float)width - 1.0f) * tan_half_x_,
+	                         (2.0f * y / (float)height - 1.0f) * tan_half_y_,
+	                         -1.0f);
+
+	*P = origin_;
+	*D = normalize(transform_direction(matrix, dir));
+}
+
+} // namespace steam
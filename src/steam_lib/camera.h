@@ -0,0 +1,37 @@
+#ifndef __STEAM_CAMERA_H__
+#define __STEAM_CAMERA_H__
+
+#include "steam_lib/util_math.h"
+
+namespace steam {
+
+/* Perspective pinhole camera following Blender conventions: the camera looks
+ * down its local -Z axis with +Y up, raster y = 0 is the bottom row. */
+
+class Camera {
+  public:
+	Camera();
+
+	/* Recompute derived values after changing matrix, fov or resolution. */
+	void update();
+
+	/* Ray through raster position (x, y), D is normalized. */
+	void generate_ray(float x, float y, float3 *P, float3 *D) const;
+
+	/* Angle covered by one pixel, the spread of the ray cone for texture
+	 * filtering. */
+	float pixel_spread() const { return 2.0f * tan_half_x_ / (float)std::max(width, 1); }
+
+	Transform matrix;	// camera to world
+	float fov;			// horizontal field of view in radians
+	int width, height;
+	float near_clip, far_clip;
+
+  private:
+	float3 origin_;
+	float tan_half_x_, tan_half_y_;
+};
+
+} // namespace steam
+
+#endif //__STEAM_CAMERA_H__
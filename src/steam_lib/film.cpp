@@ -0,0 +1,27 @@
+#include <algorithm>
+
+#include "steam_lib/film.h"
+
+namespace steam {
+
+Film::Film(): width_(0), height_(0) {
+
+}
+
+void Film::resize(int width, int height) {
+	width_ = width;
+	height_ = height;
+	buffer_.assign((size_t)width * height * 4, 0.0f);
+}
+
+void Film::reset() {
+	std::fill(buffer_.begin(), buffer_.end(), 0.0f);
+}
+
+void Film::get_pixels(float *rgba, int num_samples) const {
+	const float scale = (num_samples > 0) ? 1.0f / (float)num_samples : 0.0f;
+	for (size_t i = 0; i < buffer_.size(); i++)
+		rgba[i] = buffer_[i] * scale;
+}
+
+} // namespace steam
@@ -0,0 +1,45 @@
+#ifndef __STEAM_FILM_H__
+#define __STEAM_FILM_H__
+
+#include <vector>
+
+#include "steam_lib/util_math.h"
+
+namespace steam {
+
+/* Accumulation buffer, RGBA sums per pixel stored bottom to top like Blender
+ * render results. Tiles never overlap so threads write without locking. */
+
+class Film {
+  public:
+	Film();
+
+	void resize(int width, int height);
+	void reset();
+
+	inline float *pixel(int x, int y) {
+		return &buffer_[((size_t)y * width_ + x) * 4];
+	}
+
+	inline void add_sample(int x, int y, const float3 &L, float alpha) {
+		float *p = pixel(x, y);
+		p[0] += L.x;
+		p[1] += L.y;
+		p[2] += L.z;
+		p[3] += alpha;
+	}
+
+	/* Write averaged RGBA pixels for num_samples into rgba (width * height * 4). */
+	void get_pixels(float *rgba, int num_samples) const;
+
+	int width() const { return width_; }
+	int height() const { return height_; }
+
+  private:
+	int width_, height_;
+	std::vector<float> buffer_;
+};
+
+} // namespace steam
+
+#endif //__STEAM_FILM_H__
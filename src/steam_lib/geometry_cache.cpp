@@ -0,0 +1,258 @@
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <thread>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "steam_lib/geometry_cache.h"
+#include "steam_lib/util_hash.h"
+
+namespace steam {
+
+namespace {
+
+const char CACHE_MAGIC[8] = {'S', 'T', 'E', 'A', 'M', 'G', 'C', '\0'};
+const uint32_t CACHE_VERSION = 1;
+
+/* File layout: header, key, then the arrays, each starting at a 16 byte
+ * aligned offset. Vertices are followed by 4 padding bytes since Embree reads
+ * 16 bytes per vertex. */
+struct CacheHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t smooth;
+	uint64_t file_size;
+	uint64_t key_size;
+	uint64_t num_verts;
+	uint64_t num_tris;
+	uint64_t num_shaders;
+	uint64_t num_normals;
+	uint64_t key_offset;
+	uint64_t verts_offset;
+	uint64_t tris_offset;
+	uint64_t shader_offset;
+	uint64_t normals_offset;
+};
+
+const size_t VERTEX_PADDING = 4;
+
+uint64_t align_offset(uint64_t offset) {
+	return (offset + 15) & ~(uint64_t)15;
+}
+
+/* Read only mapping of a whole file, unmapped with the last mesh using it. */
+class MappedFile {
+  public:
+	MappedFile(): data_(nullptr), size_(0) {}
+
+	~MappedFile() {
+		if (data_)
+			munmap(data_, size_);
+	}
+
+	bool open(const std::string &path) {
+		const int fd = ::open(path.c_str(), O_RDONLY);
+		if (fd < 0)
+			return false;
+
+		struct stat st;
+		if (fstat(fd, &st) == 0 && st.st_size > 0) {
+			void *data = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+			if (data != MAP_FAILED) {
+				data_ = data;
+				size_ = (size_t)st.st_size;
+			}
+		}
+
+		close(fd);
+		return data_ != nullptr;
+	}
+
+	const char *data() const { return (const char *)data_; }
+	size_t size() const { return size_; }
+
+  private:
+	void *data_;
+	size_t size_;
+};
+
+/* count elements of element_size bytes plus padding fit at offset. The count
+ * is checked before multiplying so huge counts can not wrap around. */
+bool section_in_file(const CacheHeader &header, uint64_t offset, uint64_t count, uint64_t element_size,
+                     uint64_t padding = 0) {
+	if (offset % 16 != 0 || offset > header.file_size || count > header.file_size / element_size)
+		return false;
+	return count * element_size + padding <= header.file_size - offset;
+}
+
+bool write_section(FILE *file, uint64_t *written, uint64_t offset, const void *data, size_t size) {
+	static const char zeros[16] = {0};
+
+	if (offset - *written > sizeof(zeros) || fwrite(zeros, 1, offset - *written, file) != offset - *written)
+		return false;
+	if (size && fwrite(data, 1, size, file) != size)
+		return false;
+
+	*written = offset + size;
+	return true;
+}
+
+/* Map the entry of key and check its header, the sections and the key. */
+bool open_entry(const std::string &path, const std::string &key, MappedFile *file, CacheHeader *header) {
+	if (!file->open(path) || file->size() < sizeof(CacheHeader))
+		return false;
+
+	memcpy(header, file->data(), sizeof(*header));
+
+	if (memcmp(header->magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) != 0 || header->version != CACHE_VERSION ||
+	    header->file_size != file->size())
+		return false;
+
+	/* Reject truncated or corrupt files instead of letting Embree read out of
+	 * bounds, and keys that only share the hash. */
+	if (!section_in_file(*header, header->key_offset, header->key_size, 1) ||
+	    !section_in_file(*header, header->verts_offset, header->num_verts, sizeof(float3), VERTEX_PADDING) ||
+	    !section_in_file(*header, header->tris_offset, header->num_tris, sizeof(int3)) ||
+	    !section_in_file(*header, header->shader_offset, header->num_shaders, sizeof(int)) ||
+	    !section_in_file(*header, header->normals_offset, header->num_normals, sizeof(float3)))
+		return false;
+
+	/* Shaders and normals are looked up per triangle and vertex. */
+	if ((header->num_shaders != 0 && header->num_shaders != header->num_tris) ||
+	    (header->num_normals != 0 && header->num_normals != header->num_verts))
+		return false;
+
+	return header->key_size == key.size() && memcmp(file->data() + header->key_offset, key.data(), key.size()) == 0;
+}
+
+} // namespace
+
+std::string GeometryCache::path(const std::string &key) const {
+	char name[32];
+	snprintf(name, sizeof(name), "%016llx.steamgc", (unsigned long long)hash_data(key.data(), key.size()));
+	return directory_ + "/" + name;
+}
+
+Mesh *GeometryCache::load(const std::string &key) const {
+	if (!enabled())
+		return nullptr;
+
+	std::shared_ptr<MappedFile> file = std::make_shared<MappedFile>();
+	CacheHeader header;
+	if (!open_entry(path(key), key, file.get(), &header))
+		return nullptr;
+
+	const int3 *tris = (const int3 *)(file->data() + header.tris_offset);
+	for (uint64_t i = 0; i < header.num_tris; i++) {
+		const int3 &t = tris[i];
+		if (t.x < 0 || t.y < 0 || t.z < 0 || (uint64_t)t.x >= header.num_verts || (uint64_t)t.y >= header.num_verts ||
+		    (uint64_t)t.z >= header.num_verts)
+			return nullptr;
+	}
+
+	std::unique_ptr<Mesh> mesh(new Mesh());
+	mesh->set_shared_vertices(file->data() + header.verts_offset, sizeof(float3), header.num_verts, true);
+	mesh->set_shared_triangles((const int *)tris, header.num_tris);
+
+	const int *shaders = (const int *)(file->data() + header.shader_offset);
+	mesh->shader.assign(shaders, shaders + header.num_shaders);
+	const float3 *normals = (const float3 *)(file->data() + header.normals_offset);
+	mesh->vertex_normals.assign(normals, normals + header.num_normals);
+	mesh->smooth = header.smooth != 0;
+
+	/* Entries are replaced by renaming over them, the mapping keeps the old
+	 * file, so the content is fixed and the scene can merge and cache it. */
+	mesh->shared_owner = file;
+	mesh->shared_read_only = true;
+	return mesh.release();
+}
+
+bool GeometryCache::contains(const std::string &key) const {
+	if (!enabled())
+		return false;
+
+	MappedFile file;
+	CacheHeader header;
+	return open_entry(path(key), key, &file, &header);
+}
+
+bool GeometryCache::supports(const Mesh &mesh) {
+	/* The file layout only has static triangle data. */
+	return !mesh.num_curves() && !mesh.has_motion() && mesh.uvs.empty();
+}
+
+bool GeometryCache::store(const std::string &key, const Mesh &mesh) const {
+	if (!enabled() || !supports(mesh))
+		return false;
+
+	CacheHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+	header.version = CACHE_VERSION;
+	header.smooth = mesh.smooth;
+	header.key_size = key.size();
+	header.num_verts = mesh.num_vertices();
+	header.num_tris = mesh.num_triangles();
+	header.num_shaders = mesh.shader.size();
+	header.num_normals = mesh.vertex_normals.size();
+
+	header.key_offset = align_offset(sizeof(header));
+	header.verts_offset = align_offset(header.key_offset + header.key_size);
+	header.tris_offset = align_offset(header.verts_offset + header.num_verts * sizeof(float3) + VERTEX_PADDING);
+	header.shader_offset = align_offset(header.tris_offset + header.num_tris * sizeof(int3));
+	header.normals_offset = align_offset(header.shader_offset + header.num_shaders * sizeof(int));
+	header.file_size = header.normals_offset + header.num_normals * sizeof(float3);
+
+	/* Write next to the final file and rename, which replaces it atomically. */
+	const std::string final_path = path(key);
+	const std::string temp_path = final_path + ".tmp." + std::to_string(getpid()) + "." +
+	                              std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id()));
+
+	FILE *file = fopen(temp_path.c_str(), "wb");
+	if (!file)
+		return false;
+
+	uint64_t written = 0;
+	bool ok = write_section(file, &written, 0, &header, sizeof(header)) &&
+	          write_section(file, &written, header.key_offset, key.data(), key.size());
+
+	/* Vertices one by one when they live in a host buffer with any stride. */
+	if (ok && mesh.has_shared_buffers()) {
+		ok = write_section(file, &written, header.verts_offset, nullptr, 0);
+		for (uint64_t i = 0; ok && i < header.num_verts; i++) {
+			const float3 P = mesh.get_vertex(i);
+			ok = write_section(file, &written, written, &P, sizeof(P));
+		}
+		ok = ok && write_section(file, &written, written, "\0\0\0\0", VERTEX_PADDING);
+
+		ok = ok && write_section(file, &written, header.tris_offset, nullptr, 0);
+		for (uint64_t i = 0; ok && i < header.num_tris; i++) {
+			const int3 t = mesh.get_triangle(i);
+			ok = write_section(file, &written, written, &t, sizeof(t));
+		}
+	}
+	else if (ok) {
+		ok = write_section(file, &written, header.verts_offset, mesh.verts.data(), header.num_verts * sizeof(float3)) &&
+		     write_section(file, &written, written, "\0\0\0\0", VERTEX_PADDING) &&
+		     write_section(file, &written, header.tris_offset, mesh.triangles.data(), header.num_tris * sizeof(int3));
+	}
+
+	ok = ok && write_section(file, &written, header.shader_offset, mesh.shader.data(), header.num_shaders * sizeof(int)) &&
+	     write_section(file, &written, header.normals_offset, mesh.vertex_normals.data(), header.num_normals * sizeof(float3));
+
+	ok = (fclose(file) == 0) && ok;
+
+	if (!ok || rename(temp_path.c_str(), final_path.c_str()) != 0) {
+		remove(temp_path.c_str());
+		return false;
+	}
+
+	return true;
+}
+
+} // namespace steam
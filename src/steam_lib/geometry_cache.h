@@ -0,0 +1,48 @@
+#ifndef __STEAM_GEOMETRY_CACHE_H__
+#define __STEAM_GEOMETRY_CACHE_H__
+
+#include <string>
+
+#include "steam_lib/mesh.h"
+
+namespace steam {
+
+/* On disk cache of converted meshes, so re-rendering the same shot can skip
+ * exporting geometry from the host.
+ *
+ * Every mesh is one file in the cache directory, named after the hash of a
+ * key chosen by the caller, which has to change whenever the geometry does.
+ * Loaded meshes memory map the file and hand positions and triangles to
+ * Embree as shared buffers, so pages are only read when the BVH is built.
+ * The mapping is read only, so the scene deduplicates loaded meshes and
+ * keeps their prototypes across frames like meshes owning their data.
+ *
+ * Embree has no way to serialize its BVHs, those are still built on load. */
+
+class GeometryCache {
+  public:
+	/* An empty directory disables the cache. */
+	void set_directory(const std::string &directory) { directory_ = directory; }
+	const std::string &directory() const { return directory_; }
+	bool enabled() const { return !directory_.empty(); }
+
+	/* New mesh from the cache, nullptr when the key is not cached or the file
+	 * is unreadable. */
+	Mesh *load(const std::string &key) const;
+	/* An entry for key exists and its header is valid, cheaper than load. */
+	bool contains(const std::string &key) const;
+	/* Curves, motion and UVs are not part of the file format. */
+	static bool supports(const Mesh &mesh);
+	/* Write the mesh, replacing an existing entry atomically so concurrent
+	 * render jobs sharing the directory never read partial files. */
+	bool store(const std::string &key, const Mesh &mesh) const;
+
+  private:
+	std::string path(const std::string &key) const;
+
+	std::string directory_;
+};
+
+} // namespace steam
+
+#endif //__STEAM_GEOMETRY_CACHE_H__
@@ -0,0 +1,293 @@
+#include <limits>
+
+#include "steam_lib/integrator.h"
+#include "steam_lib/integrator_stream.h"
+#include "steam_lib/util_random.h"
+
+namespace steam {
+
+PathTracer::PathTracer(const Scene *scene, const IntegratorParams &params): scene_(scene), params_(params) {
+
+}
+
+PathTracer *PathTracer::create(const Scene *scene, const IntegratorParams &params) {
+	if (params.mode == INTEGRATOR_RAY_STREAM)
+		return new StreamPathTracer(scene, params);
+
+	return new PathTracer(scene, params);
+}
+
+bool PathTracer::intersect(const float3 &P, const float3 &D, float time, float tfar, RTCRayHit *rayhit) const {
+	RTCIntersectContext context;
+	rtcInitIntersectContext(&context);
+
+	RTCRay &ray = rayhit->ray;
+	ray.org_x = P.x; ray.org_y = P.y; ray.org_z = P.z;
+	ray.dir_x = D.x; ray.dir_y = D.y; ray.dir_z = D.z;
+	ray.tnear = 0.0f;
+	ray.tfar = tfar;
+	ray.time = time;
+	ray.mask = -1;
+	ray.id = 0;
+	ray.flags = 0;
+	rayhit->hit.geomID = RTC_INVALID_GEOMETRY_ID;
+	rayhit->hit.instID[0] = RTC_INVALID_GEOMETRY_ID;
+
+	rtcIntersect1(scene_->rtc_scene(), &context, rayhit);
+	return rayhit->hit.geomID != RTC_INVALID_GEOMETRY_ID;
+}
+
+bool PathTracer::occluded(const float3 &P, const float3 &D, float time, float tfar) const {
+	RTCIntersectContext context;
+	rtcInitIntersectContext(&context);
+
+	RTCRay ray;
+	ray.org_x = P.x; ray.org_y = P.y; ray.org_z = P.z;
+	ray.dir_x = D.x; ray.dir_y = D.y; ray.dir_z = D.z;
+	ray.tnear = 0.0f;
+	ray.tfar = tfar;
+	ray.time = time;
+	ray.mask = -1;
+	ray.id = 0;
+	ray.flags = 0;
+
+	rtcOccluded1(scene_->rtc_scene(), &context, &ray);
+	/* Embree sets tfar to -inf when a hit was found. */
+	return ray.tfar < 0.0f;
+}
+
+float3 PathTracer::surface_color(const Shader &shader, const Mesh *mesh, unsigned int geom, unsigned int prim, float u, float v,
+                                 float cone_width) const {
+	if (shader.color_texture < 0 || mesh->is_curve(geom) || !mesh->has_uvs())
+		return shader.color;
+
+	float uv_scale;
+	const float2 uv = mesh->get_uv(prim, u, v, &uv_scale);
+	const float4 tex = scene_->textures.lookup(shader.color_texture, uv.x, uv.y, cone_width * uv_scale);
+	return shader.color * make_float3(tex.x, tex.y, tex.z);
+}
+
+float PathTracer::shadow(const float3 &P, const float3 &D, float time, float tfar, RandomSequence *rng) const {
+	if (occluded(P, D, time, tfar))
+		return 0.0f;
+
+	return scene_->volumes.empty() ? 1.0f : volume_transmittance(P, D, tfar, rng);
+}
+
+float3 PathTracer::direct_light(const float3 &P, const float3 &N, float time, RandomSequence *rng) const {
+	float3 L = make_float3(0.0f);
+
+	for (const Light &light: scene_->lights) {
+		float3 dir;
+		float dist;
+		float3 strength;
+
+		if (!light_eval(light, P, &dir, &dist, &strength))
+			continue;
+
+		float cos_theta = dot(N, dir);
+		if (cos_theta <= 0.0f)
+			continue;
+
+		L += strength * (cos_theta * shadow(P, dir, time, dist * 0.9999f, rng));
+	}
+
+	return L;
+}
+
+float3 PathTracer::direct_light_volume(const float3 &P, float time, RandomSequence *rng) const {
+	float3 L = make_float3(0.0f);
+
+	for (const Light &light: scene_->lights) {
+		float3 dir;
+		float dist;
+		float3 strength;
+
+		if (light_eval(light, P, &dir, &dist, &strength))
+			L += strength * shadow(P, dir, time, dist * 0.9999f, rng);
+	}
+
+	return L * (0.25f * M_1_PI_F);
+}
+
+bool PathTracer::volume_scatter(const float3 &P, const float3 &D, float tfar, RandomSequence *rng, float *t, float3 *albedo) const {
+	bool scattered = false;
+
+	for (const Volume *volume: scene_->volumes) {
+		float t0, t1;
+		if (!(volume->max_extinction() > 0.0f) || !volume->intersect_bounds(P, D, tfar, &t0, &t1))
+			continue;
+
+		/* Free flights of overlapping volumes are independent, the nearest
+		 * collision of all of them is the one of the combined medium. */
+		if (scattered)
+			t1 = std::min(t1, *t);
+
+		/* Delta tracking against the majorant of each brick. Free flights are
+		 * memoryless, so sampling starts over at every brick boundary and
+		 * empty bricks cost nothing. */
+		volume->traverse(P, D, t0, t1, [&](float ta, float tb, float min_extinction, float max_extinction) {
+			if (!(max_extinction > 0.0f))
+				return true;
+
+			for (float s = ta;;) {
+				s -= logf(1.0f - rng->next()) / max_extinction;
+				if (s >= tb)
+					return true;
+
+				/* Every collision is real in a uniform brick. */
+				if (min_extinction == max_extinction ||
+				    rng->next() * max_extinction < volume->extinction(P + D * s)) {
+					*t = s;
+					*albedo = volume->albedo;
+					scattered = true;
+					return false;
+				}
+			}
+		});
+	}
+
+	return scattered;
+}
+
+float PathTracer::volume_transmittance(const float3 &P, const float3 &D, float tfar, RandomSequence *rng) const {
+	float T = 1.0f;
+
+	for (const Volume *volume: scene_->volumes) {
+		float t0, t1;
+		if (!(volume->max_extinction() > 0.0f) || !volume->intersect_bounds(P, D, tfar, &t0, &t1))
+			continue;
+
+		/* Ratio tracking per brick, uniform bricks attenuate analytically. */
+		volume->traverse(P, D, t0, t1, [&](float ta, float tb, float min_extinction, float max_extinction) {
+			if (!(max_extinction > 0.0f))
+				return true;
+
+			if (min_extinction == max_extinction) {
+				T *= expf(-max_extinction * (tb - ta));
+				return T > 0.0f;
+			}
+
+			for (float s = ta;;) {
+				s -= logf(1.0f - rng->next()) / max_extinction;
+				if (s >= tb)
+					return true;
+
+				T *= std::max(0.0f, 1.0f - volume->extinction(P + D * s) / max_extinction);
+				if (T == 0.0f)
+					return false;
+			}
+		});
+
+		if (T == 0.0f)
+			return 0.0f;
+	}
+
+	return T;
+}
+
+float3 PathTracer::trace(float3 P, float3 D, uint32_t rng_hash, int sample, float *alpha) const {
+	const float inf = std::numeric_limits<float>::infinity();
+	float3 L = make_float3(0.0f);
+	float3 throughput = make_float3(1.0f);
+	const float time = path_rng_1D(rng_hash, sample, PRNG_TIME);
+	float cone_width = 0.0f;
+	float cone_spread = scene_->camera.pixel_spread();
+	*alpha = 1.0f;
+
+	for (int bounce = 0; bounce <= params_.max_bounces; bounce++) {
+		RTCRayHit rayhit;
+		const bool hit = intersect(P, D, time, inf, &rayhit);
+
+		const int dim = PRNG_BASE_NUM + bounce * PRNG_BOUNCE_NUM;
+		RandomSequence rng(rng_hash, sample, dim + PRNG_VOLUME);
+
+		float t;
+		float3 albedo;
+		if (!scene_->volumes.empty() && volume_scatter(P, D, hit ? rayhit.ray.tfar : inf, &rng, &t, &albedo)) {
+			/* Scatter inside the volume, the isotropic phase function and its
+			 * pdf cancel. */
+			P = P + D * t;
+			cone_width += cone_spread * t;
+			cone_spread = std::max(cone_spread, DIFFUSE_CONE_SPREAD);
+			throughput *= albedo;
+			L += throughput * direct_light_volume(P, time, &rng);
+
+			D = sample_uniform_sphere(path_rng_1D(rng_hash, sample, dim + PRNG_BSDF_U),
+			                          path_rng_1D(rng_hash, sample, dim + PRNG_BSDF_V));
+		}
+		else {
+			if (!hit) {
+				if (bounce == 0 && params_.transparent_background)
+					*alpha = 0.0f;
+				else
+					L += throughput * scene_->background;
+				break;
+			}
+
+			const Transform *tfm;
+			const Mesh *mesh = scene_->find_mesh(rayhit.hit.geomID, rayhit.hit.instID[0], &tfm);
+			if (!mesh)
+				break;
+
+			float3 Ng, N;
+			hit_normals(mesh, tfm, rayhit.hit.geomID, rayhit.hit.primID, rayhit.hit.u, rayhit.hit.v,
+			            make_float3(rayhit.hit.Ng_x, rayhit.hit.Ng_y, rayhit.hit.Ng_z), D, &Ng, &N);
+			const Shader &shader = scene_->get_shader(mesh->get_shader(rayhit.hit.geomID, rayhit.hit.primID));
+			cone_width += cone_spread * rayhit.ray.tfar;
+			const float3 color = surface_color(shader, mesh, rayhit.hit.geomID, rayhit.hit.primID, rayhit.hit.u, rayhit.hit.v,
+			                                   cone_width);
+
+			P = ray_offset(P + D * rayhit.ray.tfar, Ng);
+			L += throughput * shader.emission;
+
+			/* Next event estimation, lambertian BSDF is color / pi. */
+			L += throughput * color * direct_light(P, N, time, &rng) * M_1_PI_F;
+
+			/* Cosine weighted bounce, pdf cancels with BSDF * cos. */
+			D = sample_cos_hemisphere(N,
+			                          path_rng_1D(rng_hash, sample, dim + PRNG_BSDF_U),
+			                          path_rng_1D(rng_hash, sample, dim + PRNG_BSDF_V));
+			throughput *= color;
+			cone_spread = std::max(cone_spread, DIFFUSE_CONE_SPREAD);
+		}
+
+		/* Russian roulette after the first couple of bounces. */
+		if (bounce >= 2) {
+			float q = std::min(reduce_max(throughput), 0.95f);
+			if (path_rng_1D(rng_hash, sample, dim + PRNG_TERMINATE) >= q)
+				break;
+			throughput *= 1.0f / q;
+		}
+	}
+
+	return L;
+}
+
+void PathTracer::render_tile(const Tile &tile, Film *film, int sample_start, int num_samples) const {
+	const Camera &camera = scene_->camera;
+
+	for (int y = tile.y; y < tile.y + tile.h; y++) {
+		for (int x = tile.x; x < tile.x + tile.w; x++) {
+			const uint32_t rng_hash = hash_pixel(x, y, params_.seed);
+
+			for (int sample = sample_start; sample < sample_start + num_samples; sample++) {
+				float3 P, D;
+				camera.generate_ray(x + path_rng_1D(rng_hash, sample, PRNG_FILTER_U),
+				                    y + path_rng_1D(rng_hash, sample, PRNG_FILTER_V),
+				                    &P, &D);
+
+				float alpha;
+				float3 L = trace(P, D, rng_hash, sample, &alpha);
+
+				/* Drop invalid samples instead of poisoning the pixel. */
+				if (!std::isfinite(L.x + L.y + L.z))
+					L = make_float3(0.0f);
+
+				film->add_sample(x, y, L, alpha);
+			}
+		}
+	}
+}
+
+} // namespace steam
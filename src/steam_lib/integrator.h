@@ -0,0 +1,161 @@
+#ifndef __STEAM_INTEGRATOR_H__
+#define __STEAM_INTEGRATOR_H__
+
+#include <cstdint>
+#include <limits>
+
+#include <embree3/rtcore.h>
+
+#include "steam_lib/film.h"
+#include "steam_lib/scene.h"
+#include "steam_lib/tile.h"
+#include "steam_lib/util_math.h"
+#include "steam_lib/util_random.h"
+
+namespace steam {
+
+enum IntegratorMode {
+	/* One ray at a time through rtcIntersect1, depth first per pixel. */
+	INTEGRATOR_SINGLE_RAY = 0,
+	/* Wavefront over a tile, rays traced as SoA streams with rtcIntersectNp. */
+	INTEGRATOR_RAY_STREAM = 1,
+};
+
+struct IntegratorParams {
+	IntegratorParams(): mode(INTEGRATOR_SINGLE_RAY), max_bounces(4), seed(0), transparent_background(false) {}
+
+	IntegratorMode mode;
+	int max_bounces;
+	uint32_t seed;
+	bool transparent_background;
+};
+
+/* Unidirectional path tracer with next event estimation for delta lights.
+ * Stateless apart from the scene pointer, so one instance is shared by all
+ * worker threads.
+ *
+ * Volumes are sampled directly from their sparse grids: delta tracking picks
+ * scattering distances and ratio tracking attenuates shadow rays, both
+ * brick by brick against the extinction range of the brick. */
+
+class PathTracer {
+  public:
+	PathTracer(const Scene *scene, const IntegratorParams &params);
+	virtual ~PathTracer() {}
+
+	/* Create the integrator selected by params.mode. */
+	static PathTracer *create(const Scene *scene, const IntegratorParams &params);
+
+	/* Render samples [sample_start, sample_start + num_samples) for the tile
+	 * and accumulate them into the film. */
+	virtual void render_tile(const Tile &tile, Film *film, int sample_start, int num_samples) const;
+
+	/* Radiance arriving along a camera ray. */
+	float3 trace(float3 P, float3 D, uint32_t rng_hash, int sample, float *alpha) const;
+
+  protected:
+	/* time is the shutter time in [0, 1] for motion blur, shared by all
+	 * rays of a path. */
+	bool intersect(const float3 &P, const float3 &D, float time, float tfar, RTCRayHit *rayhit) const;
+	bool occluded(const float3 &P, const float3 &D, float time, float tfar) const;
+
+	/* Light arriving at P from all delta lights, times the cosine term. */
+	float3 direct_light(const float3 &P, const float3 &N, float time, RandomSequence *rng) const;
+	/* Same for a scattering event inside a volume, times the isotropic phase function. */
+	float3 direct_light_volume(const float3 &P, float time, RandomSequence *rng) const;
+
+	/* Base color at a surface hit, textured when the shader has an image.
+	 * cone_width is the ray footprint at the hit and selects the MIP level. */
+	float3 surface_color(const Shader &shader, const Mesh *mesh, unsigned int geom, unsigned int prim, float u, float v,
+	                     float cone_width) const;
+
+	/* Fraction of light passing a shadow ray, zero if a surface blocks it. */
+	float shadow(const float3 &P, const float3 &D, float time, float tfar, RandomSequence *rng) const;
+
+	/* Delta tracking through all volumes along the ray up to tfar. Returns
+	 * true for a real collision, with its distance and the albedo of the
+	 * volume it happened in. */
+	bool volume_scatter(const float3 &P, const float3 &D, float tfar, RandomSequence *rng, float *t, float3 *albedo) const;
+	/* Transmittance of all volumes along the ray up to tfar, by ratio tracking. */
+	float volume_transmittance(const float3 &P, const float3 &D, float tfar, RandomSequence *rng) const;
+
+	const Scene *scene_;
+	IntegratorParams params_;
+};
+
+/* Helpers shared by the integrator implementations. */
+
+/* Texture footprints follow ray cones: the width grows with distance by the
+ * spread angle, which starts at the pixel angle of the camera. Diffuse
+ * bounces and volume scattering send rays everywhere, so after those the
+ * cone is widened to this spread. */
+static const float DIFFUSE_CONE_SPREAD = 0.1f;
+
+inline float3 sample_cos_hemisphere(const float3 &N, float u, float v) {
+	float r = sqrtf(u);
+	float phi = 2.0f * M_PI_F * v;
+	float x = r * cosf(phi), y = r * sinf(phi);
+	float3 T, B;
+	make_orthonormals(N, &T, &B);
+	return x * T + y * B + sqrtf(std::max(0.0f, 1.0f - u)) * N;
+}
+
+inline float3 sample_uniform_sphere(float u, float v) {
+	float z = 1.0f - 2.0f * u;
+	float r = sqrtf(std::max(0.0f, 1.0f - z * z));
+	float phi = 2.0f * M_PI_F * v;
+	return make_float3(r * cosf(phi), r * sinf(phi), z);
+}
+
+/* Evaluate a delta light at P: direction towards the light, distance for the
+ * shadow ray and incoming light before the cosine term. */
+inline bool light_eval(const Light &light, const float3 &P, float3 *dir, float *dist, float3 *strength) {
+	if (light.type == LIGHT_SUN) {
+		*dir = -normalize(light.dir);
+		*dist = std::numeric_limits<float>::infinity();
+		*strength = light.strength;
+		return true;
+	}
+
+	float3 D = light.co - P;
+	float dist2 = len_squared(D);
+	if (dist2 == 0.0f)
+		return false;
+
+	*dist = sqrtf(dist2);
+	*dir = D / *dist;
+	*strength = light.strength * (0.25f * M_1_PI_F / dist2);
+	return true;
+}
+
+/* Geometric and shading normal at a hit, in world space and facing against
+ * D. Ng is the normal reported by Embree, in object space for hits inside an
+ * instance with transform tfm. */
+inline void hit_normals(const Mesh *mesh, const Transform *tfm, unsigned int geom, unsigned int prim, float u, float v,
+                        float3 Ng, const float3 &D, float3 *r_Ng, float3 *r_N) {
+	Ng = normalize(Ng);
+	float3 N = mesh->shading_normal(geom, prim, u, v, Ng);
+
+	if (tfm) {
+		Ng = normalize(transform_normal(*tfm, Ng));
+		N = normalize(transform_normal(*tfm, N));
+	}
+
+	if (dot(Ng, D) > 0.0f) {
+		Ng = -Ng;
+		N = -N;
+	}
+
+	*r_Ng = Ng;
+	*r_N = N;
+}
+
+/* Offset a ray origin along the geometric normal to avoid self intersection. */
+inline float3 ray_offset(const float3 &P, const float3 &Ng) {
+	const float eps = 1e-4f * std::max(1.0f, reduce_max(make_float3(fabsf(P.x), fabsf(P.y), fabsf(P.z))));
+	return P + Ng * eps;
+}
+
+} // namespace steam
+
+#endif //__STEAM_INTEGRATOR_H__
@@ -0,0 +1,271 @@
+#include <limits>
+
+#include "steam_lib/integrator_stream.h"
+#include "steam_lib/util_random.h"
+
+namespace steam {
+
+void RayStream::resize(size_t size) {
+	for (std::vector<float> *f: {&org_x, &org_y, &org_z, &tnear, &dir_x, &dir_y, &dir_z, &time, &tfar, &Ng_x, &Ng_y, &Ng_z, &u, &v})
+		f->resize(size);
+	for (std::vector<unsigned int> *i: {&mask, &id, &flags, &primID, &geomID, &instID})
+		i->resize(size);
+}
+
+RTCRayNp RayStream::ray_np() {
+	RTCRayNp ray;
+	ray.org_x = org_x.data(); ray.org_y = org_y.data(); ray.org_z = org_z.data();
+	ray.tnear = tnear.data();
+	ray.dir_x = dir_x.data(); ray.dir_y = dir_y.data(); ray.dir_z = dir_z.data();
+	ray.time = time.data();
+	ray.tfar = tfar.data();
+	ray.mask = mask.data();
+	ray.id = id.data();
+	ray.flags = flags.data();
+	return ray;
+}
+
+RTCRayHitNp RayStream::rayhit_np() {
+	RTCRayHitNp rayhit;
+	rayhit.ray = ray_np();
+	rayhit.hit.Ng_x = Ng_x.data(); rayhit.hit.Ng_y = Ng_y.data(); rayhit.hit.Ng_z = Ng_z.data();
+	rayhit.hit.u = u.data();
+	rayhit.hit.v = v.data();
+	rayhit.hit.primID = primID.data();
+	rayhit.hit.geomID = geomID.data();
+	rayhit.hit.instID[0] = instID.data();
+	return rayhit;
+}
+
+namespace {
+
+/* Per path state that lives across bounces. */
+struct PathStateSoA {
+	void resize(size_t size) {
+		throughput.resize(size);
+		L.resize(size);
+		alpha.resize(size);
+		rng_hash.resize(size);
+		time.resize(size);
+		cone_width.resize(size);
+		cone_spread.resize(size);
+		x.resize(size);
+		y.resize(size);
+	}
+
+	std::vector<float3> throughput;
+	std::vector<float3> L;
+	std::vector<float> alpha;
+	std::vector<uint32_t> rng_hash;
+	/* Shutter time of the path, for all its rays. */
+	std::vector<float> time;
+	/* Ray cone for texture filtering. */
+	std::vector<float> cone_width;
+	std::vector<float> cone_spread;
+	std::vector<int> x, y;
+};
+
+/* Pending shadow ray contributions, indexed like the shadow stream. */
+struct ShadowQueue {
+	void resize(size_t size) {
+		contribution.resize(size);
+		path.resize(size);
+	}
+
+	std::vector<float3> contribution;
+	std::vector<unsigned int> path;
+};
+
+} // namespace
+
+StreamPathTracer::StreamPathTracer(const Scene *scene, const IntegratorParams &params): PathTracer(scene, params) {
+
+}
+
+void StreamPathTracer::render_tile(const Tile &tile, Film *film, int sample_start, int num_samples) const {
+	const size_t num_paths = (size_t)tile.w * tile.h;
+	const size_t num_lights = scene_->lights.size();
+	const Camera &camera = scene_->camera;
+	const float inf = std::numeric_limits<float>::infinity();
+	const float pixel_spread = camera.pixel_spread();
+
+	/* Buffers are reused for all samples of the tile. */
+	RayStream rays, next_rays, shadow_rays;
+	PathStateSoA state;
+	ShadowQueue shadow;
+
+	rays.resize(num_paths);
+	next_rays.resize(num_paths);
+	shadow_rays.resize(num_paths * std::max<size_t>(num_lights, 1));
+	shadow.resize(shadow_rays.size());
+	state.resize(num_paths);
+
+	for (size_t i = 0; i < num_paths; i++) {
+		state.x[i] = tile.x + (int)(i % tile.w);
+		state.y[i] = tile.y + (int)(i / tile.w);
+		state.rng_hash[i] = hash_pixel(state.x[i], state.y[i], params_.seed);
+	}
+
+	for (int sample = sample_start; sample < sample_start + num_samples; sample++) {
+		/* Camera rays, in scanline order within the tile. */
+		for (size_t i = 0; i < num_paths; i++) {
+			const uint32_t rng_hash = state.rng_hash[i];
+			float3 P, D;
+			camera.generate_ray(state.x[i] + path_rng_1D(rng_hash, sample, PRNG_FILTER_U),
+			                    state.y[i] + path_rng_1D(rng_hash, sample, PRNG_FILTER_V),
+			                    &P, &D);
+			state.time[i] = path_rng_1D(rng_hash, sample, PRNG_TIME);
+			rays.set_ray(i, P, D, state.time[i], inf, (unsigned int)i);
+
+			state.throughput[i] = make_float3(1.0f);
+			state.L[i] = make_float3(0.0f);
+			state.alpha[i] = 1.0f;
+			state.cone_width[i] = 0.0f;
+			state.cone_spread[i] = pixel_spread;
+		}
+
+		size_t num_active = num_paths;
+
+		for (int bounce = 0; bounce <= params_.max_bounces && num_active > 0; bounce++) {
+			RTCIntersectContext context;
+			rtcInitIntersectContext(&context);
+			context.flags = (bounce == 0) ? RTC_INTERSECT_CONTEXT_FLAG_COHERENT : RTC_INTERSECT_CONTEXT_FLAG_INCOHERENT;
+
+			RTCRayHitNp rayhit = rays.rayhit_np();
+			rtcIntersectNp(scene_->rtc_scene(), &context, &rayhit, (unsigned int)num_active);
+
+			const int dim = PRNG_BASE_NUM + bounce * PRNG_BOUNCE_NUM;
+			size_t num_next = 0;
+			size_t num_shadow = 0;
+
+			/* Volume attenuation of shadow rays is tracked right away, surfaces
+			 * are left to the occlusion stream. */
+			auto queue_shadow = [&](const float3 &P, const float3 &dir, float dist, unsigned int p,
+			                        const float3 &contribution, RandomSequence *rng) {
+				const float tfar = dist * 0.9999f;
+				const float T = scene_->volumes.empty() ? 1.0f : volume_transmittance(P, dir, tfar, rng);
+				if (T == 0.0f)
+					return;
+
+				shadow_rays.set_ray(num_shadow, P, dir, state.time[p], tfar, (unsigned int)num_shadow);
+				shadow.contribution[num_shadow] = contribution * T;
+				shadow.path[num_shadow] = p;
+				num_shadow++;
+			};
+
+			/* Shade hits, queue shadow rays and generate continuation rays. */
+			for (size_t r = 0; r < num_active; r++) {
+				const unsigned int p = rays.id[r];
+				const float3 D = rays.D(r);
+				const bool hit = rays.geomID[r] != RTC_INVALID_GEOMETRY_ID;
+				const uint32_t rng_hash = state.rng_hash[p];
+				RandomSequence rng(rng_hash, sample, dim + PRNG_VOLUME);
+
+				float3 P, D_next, throughput;
+				float t;
+				float3 albedo;
+				if (!scene_->volumes.empty() && volume_scatter(rays.P(r), D, hit ? rays.tfar[r] : inf, &rng, &t, &albedo)) {
+					/* Scatter inside the volume, isotropic phase function. */
+					P = rays.P(r) + D * t;
+					throughput = state.throughput[p] * albedo;
+					state.cone_width[p] += state.cone_spread[p] * t;
+
+					const float3 phase = throughput * (0.25f * M_1_PI_F);
+					for (const Light &light: scene_->lights) {
+						float3 dir, strength;
+						float dist;
+						if (light_eval(light, P, &dir, &dist, &strength))
+							queue_shadow(P, dir, dist, p, phase * strength, &rng);
+					}
+
+					D_next = sample_uniform_sphere(path_rng_1D(rng_hash, sample, dim + PRNG_BSDF_U),
+					                               path_rng_1D(rng_hash, sample, dim + PRNG_BSDF_V));
+				}
+				else {
+					if (!hit) {
+						if (bounce == 0 && params_.transparent_background)
+							state.alpha[p] = 0.0f;
+						else
+							state.L[p] += state.throughput[p] * scene_->background;
+						continue;
+					}
+
+					const Transform *tfm;
+					const Mesh *mesh = scene_->find_mesh(rays.geomID[r], rays.instID[r], &tfm);
+					if (!mesh)
+						continue;
+
+					float3 Ng, N;
+					hit_normals(mesh, tfm, rays.geomID[r], rays.primID[r], rays.u[r], rays.v[r],
+					            make_float3(rays.Ng_x[r], rays.Ng_y[r], rays.Ng_z[r]), D, &Ng, &N);
+					const Shader &shader = scene_->get_shader(mesh->get_shader(rays.geomID[r], rays.primID[r]));
+					state.cone_width[p] += state.cone_spread[p] * rays.tfar[r];
+					const float3 color = surface_color(shader, mesh, rays.geomID[r], rays.primID[r], rays.u[r], rays.v[r],
+					                                   state.cone_width[p]);
+					P = ray_offset(rays.P(r) + D * rays.tfar[r], Ng);
+
+					state.L[p] += state.throughput[p] * shader.emission;
+
+					/* Next event estimation, evaluated after the occlusion stream. */
+					const float3 bsdf = state.throughput[p] * color * M_1_PI_F;
+					for (const Light &light: scene_->lights) {
+						float3 dir, strength;
+						float dist;
+						if (!light_eval(light, P, &dir, &dist, &strength))
+							continue;
+
+						const float cos_theta = dot(N, dir);
+						if (cos_theta <= 0.0f)
+							continue;
+
+						queue_shadow(P, dir, dist, p, bsdf * strength * cos_theta, &rng);
+					}
+
+					throughput = state.throughput[p] * color;
+					D_next = sample_cos_hemisphere(N,
+					                               path_rng_1D(rng_hash, sample, dim + PRNG_BSDF_U),
+					                               path_rng_1D(rng_hash, sample, dim + PRNG_BSDF_V));
+				}
+
+				/* Continuation ray, compacted into the next stream. */
+				if (bounce >= 2) {
+					float q = std::min(reduce_max(throughput), 0.95f);
+					if (path_rng_1D(rng_hash, sample, dim + PRNG_TERMINATE) >= q)
+						continue;
+					throughput *= 1.0f / q;
+				}
+				state.throughput[p] = throughput;
+				state.cone_spread[p] = std::max(state.cone_spread[p], DIFFUSE_CONE_SPREAD);
+
+				next_rays.set_ray(num_next++, P, D_next, state.time[p], inf, p);
+			}
+
+			/* Trace all shadow rays of this bounce in one stream. */
+			if (num_shadow > 0) {
+				RTCIntersectContext shadow_context;
+				rtcInitIntersectContext(&shadow_context);
+
+				RTCRayNp shadow_np = shadow_rays.ray_np();
+				rtcOccludedNp(scene_->rtc_scene(), &shadow_context, &shadow_np, (unsigned int)num_shadow);
+
+				for (size_t s = 0; s < num_shadow; s++) {
+					/* Embree sets tfar to -inf for occluded rays. */
+					if (shadow_rays.tfar[s] >= 0.0f)
+						state.L[shadow.path[s]] += shadow.contribution[s];
+				}
+			}
+
+			std::swap(rays, next_rays);
+			num_active = num_next;
+		}
+
+		for (size_t i = 0; i < num_paths; i++) {
+			float3 L = state.L[i];
+			if (!std::isfinite(L.x + L.y + L.z))
+				L = make_float3(0.0f);
+			film->add_sample(state.x[i], state.y[i], L, state.alpha[i]);
+		}
+	}
+}
+
+} // namespace steam
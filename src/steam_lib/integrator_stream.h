@@ -0,0 +1,60 @@
+#ifndef __STEAM_INTEGRATOR_STREAM_H__
+#define __STEAM_INTEGRATOR_STREAM_H__
+
+#include <vector>
+
+#include <embree3/rtcore.h>
+
+#include "steam_lib/integrator.h"
+
+namespace steam {
+
+/* Structure of arrays ray storage, laid out the way rtcIntersectNp and
+ * rtcOccludedNp expect it. The ray id holds the index of the owning path. */
+
+struct RayStream {
+	void resize(size_t size);
+	size_t size() const { return org_x.size(); }
+
+	void set_ray(size_t i, const float3 &P, const float3 &D, float ray_time, float ray_tfar, unsigned int ray_id) {
+		org_x[i] = P.x; org_y[i] = P.y; org_z[i] = P.z;
+		dir_x[i] = D.x; dir_y[i] = D.y; dir_z[i] = D.z;
+		tnear[i] = 0.0f;
+		tfar[i] = ray_tfar;
+		time[i] = ray_time;
+		mask[i] = 0xFFFFFFFF;
+		id[i] = ray_id;
+		flags[i] = 0;
+		geomID[i] = RTC_INVALID_GEOMETRY_ID;
+		instID[i] = RTC_INVALID_GEOMETRY_ID;
+	}
+
+	float3 P(size_t i) const { return make_float3(org_x[i], org_y[i], org_z[i]); }
+	float3 D(size_t i) const { return make_float3(dir_x[i], dir_y[i], dir_z[i]); }
+
+	RTCRayNp ray_np();
+	RTCRayHitNp rayhit_np();
+
+	std::vector<float> org_x, org_y, org_z, tnear;
+	std::vector<float> dir_x, dir_y, dir_z, time;
+	std::vector<float> tfar;
+	std::vector<unsigned int> mask, id, flags;
+
+	std::vector<float> Ng_x, Ng_y, Ng_z, u, v;
+	std::vector<unsigned int> primID, geomID, instID;
+};
+
+/* Wavefront path tracer: all paths of a tile advance one bounce at a time.
+ * Camera rays of a tile are coherent and go through Embree's packet kernels,
+ * shadow rays of a bounce are batched into one occlusion stream. */
+
+class StreamPathTracer : public PathTracer {
+  public:
+	StreamPathTracer(const Scene *scene, const IntegratorParams &params);
+
+	void render_tile(const Tile &tile, Film *film, int sample_start, int num_samples) const override;
+};
+
+} // namespace steam
+
+#endif //__STEAM_INTEGRATOR_STREAM_H__
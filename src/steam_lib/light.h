@@ -0,0 +1,28 @@
+#ifndef __STEAM_LIGHT_H__
+#define __STEAM_LIGHT_H__
+
+#include "steam_lib/util_math.h"
+
+namespace steam {
+
+enum LightType {
+	LIGHT_POINT = 0,
+	LIGHT_SUN = 1,
+};
+
+/* Delta lights, sampled with a single shadow ray per shading point.
+ * For point lights co is the position, for sun lights dir points from the
+ * light towards the scene. */
+
+struct Light {
+	Light(): type(LIGHT_POINT), co(make_float3(0.0f)), dir(make_float3(0.0f, 0.0f, -1.0f)), strength(make_float3(1.0f)) {}
+
+	LightType type;
+	float3 co;
+	float3 dir;
+	float3 strength;
+};
+
+} // namespace steam
+
+#endif //__STEAM_LIGHT_H__
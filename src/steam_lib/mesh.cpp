@@ -0,0 +1,411 @@
+#include <cstring>
+
+#include "steam_lib/mesh.h"
+#include "steam_lib/util_hash.h"
+
+namespace steam {
+
+Mesh::Mesh()
+    : smooth(false), curve_shape(CURVE_THICK), motion_steps(1), geom_id(RTC_INVALID_GEOMETRY_ID), curve_geom_id(RTC_INVALID_GEOMETRY_ID),
+      shared_read_only(false), rtc_geom_(nullptr), rtc_curve_geom_(nullptr) {
+
+}
+
+Mesh::~Mesh() {
+	if (rtc_geom_)
+		rtcReleaseGeometry(rtc_geom_);
+	if (rtc_curve_geom_)
+		rtcReleaseGeometry(rtc_curve_geom_);
+}
+
+void Mesh::clear() {
+	verts.clear();
+	triangles.clear();
+	shader.clear();
+	vertex_normals.clear();
+	uvs.clear();
+	curve_keys.clear();
+	curve_first_key.clear();
+	curve_shader.clear();
+	motion_verts.clear();
+	motion_curve_keys.clear();
+	motion_steps = 1;
+
+	shared_verts_ = SharedBuffer();
+	shared_tris_ = SharedBuffer();
+	shared_owner.reset();
+	shared_read_only = false;
+}
+
+void Mesh::set_shared_vertices(const void *data, size_t stride, size_t num_verts, bool padded) {
+	if (stride < 16 && !padded) {
+		/* Can't let Embree read past the end of host memory, copy instead. */
+		verts.resize(num_verts);
+		for (size_t i = 0; i < num_verts; i++) {
+			const float *co = (const float *)((const char *)data + i * stride);
+			verts[i] = make_float3(co[0], co[1], co[2]);
+		}
+		shared_verts_ = SharedBuffer();
+		return;
+	}
+
+	verts.clear();
+	shared_verts_.data = (const char *)data;
+	shared_verts_.stride = stride;
+	shared_verts_.count = num_verts;
+}
+
+void Mesh::set_shared_triangles(const int *data, size_t num_tris) {
+	triangles.clear();
+	shared_tris_.data = (const char *)data;
+	shared_tris_.stride = sizeof(int3);
+	shared_tris_.count = num_tris;
+}
+
+void Mesh::reserve(size_t num_verts, size_t num_tris) {
+	verts.reserve(num_verts);
+	triangles.reserve(num_tris);
+	shader.reserve(num_tris);
+}
+
+void Mesh::add_vertex(const float3 &P) {
+	verts.push_back(P);
+}
+
+void Mesh::add_triangle(int v0, int v1, int v2, int shader_index) {
+	triangles.push_back(make_int3(v0, v1, v2));
+	shader.push_back(shader_index);
+}
+
+void Mesh::reserve_curves(size_t num_keys, size_t num_curves) {
+	curve_keys.reserve(num_keys);
+	curve_first_key.reserve(num_curves);
+	curve_shader.reserve(num_curves);
+}
+
+void Mesh::add_curve_key(const float3 &P, float radius) {
+	curve_keys.push_back(make_float4(P, radius));
+}
+
+void Mesh::add_curve(int first_key, int shader_index) {
+	curve_first_key.push_back(first_key);
+	curve_shader.push_back(shader_index);
+}
+
+float3 Mesh::shading_normal(unsigned int geom, unsigned int prim, float u, float v, const float3 &Ng) const {
+	if (is_curve(geom) || !smooth || vertex_normals.size() != num_vertices())
+		return Ng;
+
+	const int3 t = get_triangle(prim);
+	float3 N = (1.0f - u - v) * vertex_normals[t.x] + u * vertex_normals[t.y] + v * vertex_normals[t.z];
+	N = normalize(N);
+
+	/* Keep the interpolated normal on the same side as the geometric one. */
+	return (dot(N, Ng) < 0.0f) ? -N : N;
+}
+
+float2 Mesh::get_uv(unsigned int prim, float u, float v, float *uv_scale) const {
+	const float2 &a = uvs[3 * prim + 0];
+	const float2 &b = uvs[3 * prim + 1];
+	const float2 &c = uvs[3 * prim + 2];
+	const float w = 1.0f - u - v;
+
+	/* Ratio of the UV and object space triangle areas. */
+	const int3 t = get_triangle(prim);
+	const float3 P0 = get_vertex(t.x);
+	const float area = len(cross(get_vertex(t.y) - P0, get_vertex(t.z) - P0));
+	const float uv_area = fabsf((b.x - a.x) * (c.y - a.y) - (c.x - a.x) * (b.y - a.y));
+	*uv_scale = (area > 0.0f) ? sqrtf(uv_area / area) : 0.0f;
+
+	return make_float2(w * a.x + u * b.x + v * c.x, w * a.y + u * b.y + v * c.y);
+}
+
+uint64_t Mesh::content_hash() const {
+	const size_t num_verts = num_vertices();
+	const size_t num_tris = num_triangles();
+
+	uint64_t h = hash_data(&num_verts, sizeof(num_verts));
+	h = hash_data(&num_tris, sizeof(num_tris), h);
+
+	/* Same hash for the same positions, whatever buffer holds them. */
+	if (shared_verts_.data && shared_verts_.stride != sizeof(float3)) {
+		std::vector<float3> P(num_verts);
+		for (size_t i = 0; i < num_verts; i++)
+			P[i] = get_vertex(i);
+		h = hash_data(P.data(), num_verts * sizeof(float3), h);
+	}
+	else {
+		const void *P = shared_verts_.data ? (const void *)shared_verts_.data : (const void *)verts.data();
+		h = hash_data(P, num_verts * sizeof(float3), h);
+	}
+
+	const void *tris = shared_tris_.data ? (const void *)shared_tris_.data : (const void *)triangles.data();
+	h = hash_data(tris, num_tris * sizeof(int3), h);
+	h = hash_data(shader.data(), shader.size() * sizeof(int), h);
+	h = hash_data(vertex_normals.data(), vertex_normals.size() * sizeof(float3), h);
+	h = hash_data(&smooth, sizeof(smooth), h);
+	h = hash_data(uvs.data(), uvs.size() * sizeof(float2), h);
+
+	const size_t num_keys = curve_keys.size();
+	h = hash_data(&num_keys, sizeof(num_keys), h);
+	h = hash_data(curve_keys.data(), num_keys * sizeof(float4), h);
+	h = hash_data(curve_first_key.data(), curve_first_key.size() * sizeof(int), h);
+	h = hash_data(curve_shader.data(), curve_shader.size() * sizeof(int), h);
+	h = hash_data(&curve_shape, sizeof(curve_shape), h);
+
+	const int num_steps = num_time_steps();
+	h = hash_data(&num_steps, sizeof(num_steps), h);
+	if (num_steps > 1) {
+		h = hash_data(motion_verts.data(), motion_verts.size() * sizeof(float3), h);
+		h = hash_data(motion_curve_keys.data(), motion_curve_keys.size() * sizeof(float4), h);
+	}
+	return h;
+}
+
+bool Mesh::same_content(const Mesh &other) const {
+	const size_t num_verts = num_vertices();
+	const size_t num_tris = num_triangles();
+
+	if (num_verts != other.num_vertices() || num_tris != other.num_triangles() || smooth != other.smooth ||
+	    shader != other.shader || vertex_normals.size() != other.vertex_normals.size() || uvs.size() != other.uvs.size())
+		return false;
+
+	if (!uvs.empty() && memcmp(uvs.data(), other.uvs.data(), uvs.size() * sizeof(float2)) != 0)
+		return false;
+
+	if (curve_keys.size() != other.curve_keys.size() || curve_first_key != other.curve_first_key ||
+	    curve_shader != other.curve_shader || curve_shape != other.curve_shape)
+		return false;
+
+	if (!curve_keys.empty() && memcmp(curve_keys.data(), other.curve_keys.data(), curve_keys.size() * sizeof(float4)) != 0)
+		return false;
+
+	if (num_time_steps() != other.num_time_steps())
+		return false;
+
+	if (num_time_steps() > 1 &&
+	    (memcmp(motion_verts.data(), other.motion_verts.data(), motion_verts.size() * sizeof(float3)) != 0 ||
+	     memcmp(motion_curve_keys.data(), other.motion_curve_keys.data(), motion_curve_keys.size() * sizeof(float4)) != 0))
+		return false;
+
+	/* Bitwise, like the hash. */
+	if (!vertex_normals.empty() &&
+	    memcmp(vertex_normals.data(), other.vertex_normals.data(), vertex_normals.size() * sizeof(float3)) != 0)
+		return false;
+
+	for (size_t i = 0; i < num_verts; i++) {
+		const float3 P = get_vertex(i);
+		const float3 other_P = other.get_vertex(i);
+		if (memcmp(&P, &other_P, sizeof(float3)) != 0)
+			return false;
+	}
+
+	for (size_t i = 0; i < num_tris; i++) {
+		const int3 t = get_triangle(i);
+		const int3 other_t = other.get_triangle(i);
+		if (memcmp(&t, &other_t, sizeof(int3)) != 0)
+			return false;
+	}
+
+	return true;
+}
+
+void Mesh::attach(RTCDevice device, RTCScene scene) {
+	if (rtc_geom_) {
+		rtcReleaseGeometry(rtc_geom_);
+		rtc_geom_ = nullptr;
+	}
+
+	attach_curves(device, scene);
+
+	const size_t num_tris = num_triangles();
+	if (num_tris == 0)
+		return;
+
+	rtc_geom_ = rtcNewGeometry(device, RTC_GEOMETRY_TYPE_TRIANGLE);
+
+	set_vertex_buffer();
+
+	const void *tris = shared_tris_.data ? (const void *)shared_tris_.data : (const void *)triangles.data();
+	rtcSetSharedGeometryBuffer(rtc_geom_, RTC_BUFFER_TYPE_INDEX, 0, RTC_FORMAT_UINT3, tris, 0, sizeof(int3), num_tris);
+
+	rtcCommitGeometry(rtc_geom_);
+	geom_id = rtcAttachGeometry(scene, rtc_geom_);
+}
+
+/* Data of a motion step, the center step is the regular array and the other
+ * steps follow each other in the motion array. */
+template<typename T>
+static const T *motion_step_data(const T *center, const std::vector<T> &motion, size_t count, int step, int num_steps) {
+	const int center_step = num_steps / 2;
+	if (step == center_step)
+		return center;
+	return motion.data() + (size_t)(step - (step > center_step)) * count;
+}
+
+void Mesh::set_vertex_buffer() {
+	const size_t num_verts = num_vertices();
+	const int num_steps = num_time_steps();
+
+	/* Embree loads vertices with 16 byte reads, make sure the allocations
+	 * extend past the last vertex. */
+	if (!shared_verts_.data && verts.capacity() < num_verts + 1)
+		verts.reserve(num_verts + 1);
+	if (num_steps > 1 && motion_verts.capacity() < motion_verts.size() + 1)
+		motion_verts.reserve(motion_verts.size() + 1);
+
+	rtcSetGeometryTimeStepCount(rtc_geom_, num_steps);
+
+	for (int step = 0; step < num_steps; step++) {
+		if (shared_verts_.data && step == num_steps / 2) {
+			rtcSetSharedGeometryBuffer(rtc_geom_, RTC_BUFFER_TYPE_VERTEX, step, RTC_FORMAT_FLOAT3, shared_verts_.data, 0,
+			                           shared_verts_.stride, num_verts);
+			continue;
+		}
+
+		const float3 *P = motion_step_data(verts.data(), motion_verts, num_verts, step, num_steps);
+		rtcSetSharedGeometryBuffer(rtc_geom_, RTC_BUFFER_TYPE_VERTEX, step, RTC_FORMAT_FLOAT3, P, 0, sizeof(float3), num_verts);
+	}
+}
+
+void Mesh::attach_curves(RTCDevice device, RTCScene scene) {
+	if (rtc_curve_geom_) {
+		rtcReleaseGeometry(rtc_curve_geom_);
+		rtc_curve_geom_ = nullptr;
+	}
+
+	build_curve_segments();
+	if (curve_segments_.empty())
+		return;
+
+	rtc_curve_geom_ = rtcNewGeometry(
+	    device, (curve_shape == CURVE_RIBBON) ? RTC_GEOMETRY_TYPE_FLAT_LINEAR_CURVE : RTC_GEOMETRY_TYPE_ROUND_BEZIER_CURVE);
+
+	set_curve_buffers();
+	rtcSetSharedGeometryBuffer(rtc_curve_geom_, RTC_BUFFER_TYPE_INDEX, 0, RTC_FORMAT_UINT, curve_segments_.data(), 0,
+	                           sizeof(unsigned int), curve_segments_.size());
+
+	rtcCommitGeometry(rtc_curve_geom_);
+	curve_geom_id = rtcAttachGeometry(scene, rtc_curve_geom_);
+}
+
+/* Catmull-Rom segment from k1 to k2 as cubic Bezier control points. */
+static void catmull_rom_to_bezier(const float4 &k0, const float4 &k1, const float4 &k2, const float4 &k3, float4 *cp) {
+	cp[0] = k1 + (k2 - k0) * (1.0f / 6.0f);
+	cp[1] = k2 - (k3 - k1) * (1.0f / 6.0f);
+	cp[2] = k2;
+}
+
+void Mesh::build_curve_segments() {
+	curve_segments_.clear();
+	segment_curve_.clear();
+	curve_bezier_.clear();
+
+	const bool ribbon = (curve_shape == CURVE_RIBBON);
+	if (!ribbon)
+		curve_bezier_.reserve(curve_keys.size() * 3);
+
+	for (size_t curve = 0; curve < num_curves(); curve++) {
+		const int first_key = curve_first_key[curve];
+		const int num_keys = curve_num_keys(curve);
+		if (num_keys < 2)
+			continue;
+
+		/* Consecutive segments share their end points, the control points
+		 * themselves are filled in by update_curve_bezier(). */
+		if (!ribbon)
+			curve_bezier_.resize(curve_bezier_.size() + 1);
+
+		for (int key = first_key; key < first_key + num_keys - 1; key++) {
+			if (ribbon) {
+				curve_segments_.push_back(key);
+			}
+			else {
+				curve_segments_.push_back((unsigned int)curve_bezier_.size() - 1);
+				curve_bezier_.resize(curve_bezier_.size() + 3);
+			}
+			segment_curve_.push_back((int)curve);
+		}
+	}
+
+	/* Motion steps repeat the same layout. */
+	curve_bezier_.resize(curve_bezier_.size() * num_time_steps());
+	update_curve_bezier();
+}
+
+void Mesh::update_curve_bezier() {
+	if (curve_shape == CURVE_RIBBON)
+		return;
+
+	const int num_steps = num_time_steps();
+	const size_t step_size = curve_bezier_.size() / num_steps;
+
+	for (int step = 0; step < num_steps; step++) {
+		const float4 *keys = motion_step_data(curve_keys.data(), motion_curve_keys, curve_keys.size(), step, num_steps);
+		float4 *bezier = curve_bezier_.data() + step * step_size;
+
+		/* Same walk as build_curve_segments(), the end points are clamped. */
+		size_t segment = 0;
+		for (size_t curve = 0; curve < num_curves(); curve++) {
+			const int first_key = curve_first_key[curve];
+			const int last_key = first_key + curve_num_keys(curve) - 1;
+			if (last_key <= first_key)
+				continue;
+
+			for (int key = first_key; key < last_key; key++, segment++) {
+				float4 *cp = bezier + curve_segments_[segment];
+				if (key == first_key)
+					cp[0] = keys[key];
+				catmull_rom_to_bezier(keys[std::max(key - 1, first_key)], keys[key], keys[key + 1],
+				                      keys[std::min(key + 2, last_key)], cp + 1);
+			}
+		}
+	}
+}
+
+void Mesh::set_curve_buffers() {
+	const int num_steps = num_time_steps();
+	const bool ribbon = (curve_shape == CURVE_RIBBON);
+	const size_t num_cps = ribbon ? curve_keys.size() : curve_bezier_.size() / num_steps;
+
+	rtcSetGeometryTimeStepCount(rtc_curve_geom_, num_steps);
+
+	for (int step = 0; step < num_steps; step++) {
+		const float4 *cps = ribbon ? motion_step_data(curve_keys.data(), motion_curve_keys, num_cps, step, num_steps) :
+		                             curve_bezier_.data() + step * num_cps;
+		rtcSetSharedGeometryBuffer(rtc_curve_geom_, RTC_BUFFER_TYPE_VERTEX, step, RTC_FORMAT_FLOAT4, cps, 0,
+		                           sizeof(float4), num_cps);
+	}
+}
+
+void Mesh::refit() {
+	if (rtc_geom_) {
+		rtcSetGeometryBuildQuality(rtc_geom_, RTC_BUILD_QUALITY_REFIT);
+		set_vertex_buffer();
+		for (int step = 0; step < num_time_steps(); step++)
+			rtcUpdateGeometryBuffer(rtc_geom_, RTC_BUFFER_TYPE_VERTEX, step);
+		rtcCommitGeometry(rtc_geom_);
+	}
+
+	if (rtc_curve_geom_) {
+		update_curve_bezier();
+		rtcSetGeometryBuildQuality(rtc_curve_geom_, RTC_BUILD_QUALITY_REFIT);
+		set_curve_buffers();
+		for (int step = 0; step < num_time_steps(); step++)
+			rtcUpdateGeometryBuffer(rtc_curve_geom_, RTC_BUFFER_TYPE_VERTEX, step);
+		rtcCommitGeometry(rtc_curve_geom_);
+	}
+}
+
+void Mesh::detach(RTCScene scene) {
+	if (geom_id != RTC_INVALID_GEOMETRY_ID) {
+		rtcDetachGeometry(scene, geom_id);
+		geom_id = RTC_INVALID_GEOMETRY_ID;
+	}
+	if (curve_geom_id != RTC_INVALID_GEOMETRY_ID) {
+		rtcDetachGeometry(scene, curve_geom_id);
+		curve_geom_id = RTC_INVALID_GEOMETRY_ID;
+	}
+}
+
+} // namespace steam
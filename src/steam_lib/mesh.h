@@ -0,0 +1,190 @@
+#ifndef __STEAM_MESH_H__
+#define __STEAM_MESH_H__
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <embree3/rtcore.h>
+
+#include "steam_lib/util_math.h"
+
+namespace steam {
+
+enum CurveShape {
+	CURVE_RIBBON = 0,
+	CURVE_THICK = 1,
+};
+
+/* Triangle mesh as synced from the host application.
+ *
+ * Vertices are stored in world space, the mesh is attached to the top level
+ * Embree scene as a single RTC_GEOMETRY_TYPE_TRIANGLE geometry.
+ *
+ * Vertex and index data is never copied into Embree: the mesh arrays, or
+ * buffers owned by the host set through set_shared_vertices() and
+ * set_shared_triangles(), are handed over with rtcSetSharedGeometryBuffer.
+ *
+ * A mesh can also hold hair curves, attached as a second geometry using
+ * Embree's own curve primitives rather than triangulated strands. Ribbons
+ * are flat linear curves through the keys, thick hair is round Bezier curves
+ * converted from the Catmull-Rom keys.
+ *
+ * Deformation motion blur uses Embree's multi segment motion: both geometries
+ * get one buffer per motion step, spread evenly over the shutter time range
+ * [0, 1], and Embree builds its motion BVH over them. */
+
+class Mesh {
+  public:
+	Mesh();
+	~Mesh();
+
+	void clear();
+	void reserve(size_t num_verts, size_t num_tris);
+
+	void add_vertex(const float3 &P);
+	void add_triangle(int v0, int v1, int v2, int shader = 0);
+
+	/* Reference host memory instead of the verts array. stride is the byte
+	 * distance between vertices, the first 12 bytes of each being xyz floats.
+	 * Embree reads 16 bytes per vertex, so with a stride below 16 the buffer
+	 * must have at least 4 readable bytes past the last vertex (padded). */
+	void set_shared_vertices(const void *data, size_t stride, size_t num_verts, bool padded);
+	/* Reference host memory holding 3 int vertex indices per triangle. */
+	void set_shared_triangles(const int *data, size_t num_tris);
+	bool has_shared_buffers() const { return shared_verts_.data || shared_tris_.data; }
+	/* Shared buffers the host can still write to, the content of the mesh
+	 * may then change without the scene knowing. */
+	bool has_mutable_buffers() const { return has_shared_buffers() && !shared_read_only; }
+
+	/* Curve keys are xyz plus radius, a curve runs from its first key up to
+	 * the first key of the next curve. Curves need at least 2 keys. */
+	void reserve_curves(size_t num_keys, size_t num_curves);
+	void add_curve_key(const float3 &P, float radius);
+	void add_curve(int first_key, int shader = 0);
+
+	size_t num_curves() const { return curve_first_key.size(); }
+	size_t num_curve_keys() const { return curve_keys.size(); }
+	int curve_num_keys(size_t curve) const {
+		const size_t end = (curve + 1 < curve_first_key.size()) ? curve_first_key[curve + 1] : curve_keys.size();
+		return (int)end - curve_first_key[curve];
+	}
+
+	size_t num_vertices() const { return shared_verts_.data ? shared_verts_.count : verts.size(); }
+	size_t num_triangles() const { return shared_tris_.data ? shared_tris_.count : triangles.size(); }
+
+	float3 get_vertex(size_t i) const {
+		if (shared_verts_.data) {
+			const float *co = (const float *)(shared_verts_.data + i * shared_verts_.stride);
+			return make_float3(co[0], co[1], co[2]);
+		}
+		return verts[i];
+	}
+
+	int3 get_triangle(size_t i) const {
+		return shared_tris_.data ? ((const int3 *)shared_tris_.data)[i] : triangles[i];
+	}
+
+	/* The center motion step is verts and curve_keys, the other steps are in
+	 * motion_verts and motion_curve_keys, in time order. Data that does not
+	 * match motion_steps is ignored and the mesh rendered without motion. */
+	bool has_motion() const {
+		return motion_steps > 1 && (motion_steps % 2) == 1 &&
+		       motion_verts.size() == (size_t)(motion_steps - 1) * num_vertices() &&
+		       motion_curve_keys.size() == (size_t)(motion_steps - 1) * curve_keys.size();
+	}
+
+	/* Primitives are triangles or curve segments, depending on which of the
+	 * two Embree geometries of the mesh was hit. */
+	bool is_curve(unsigned int geom) const { return geom == curve_geom_id; }
+
+	/* Shader index of the given triangle or curve segment. */
+	int get_shader(unsigned int geom, unsigned int prim) const {
+		if (is_curve(geom))
+			return curve_shader[segment_curve_[prim]];
+		return shader.empty() ? 0 : shader[prim];
+	}
+
+	/* Shading normal at barycentric (u, v) of the given triangle, curves
+	 * shade with the normal Embree reports. */
+	float3 shading_normal(unsigned int geom, unsigned int prim, float u, float v, const float3 &Ng) const;
+
+	/* Texture coordinate at barycentric (u, v) of a triangle, and the UV
+	 * distance per object space distance on it for texture filtering. */
+	bool has_uvs() const { return uvs.size() == 3 * num_triangles(); }
+	float2 get_uv(unsigned int prim, float u, float v, float *uv_scale) const;
+
+	/* Fingerprint of everything that affects rendering: positions,
+	 * triangles, curves, shaders, normals, UVs and motion, but not the name. */
+	uint64_t content_hash() const;
+	/* Full compare of the same data, to confirm a content_hash() match. */
+	bool same_content(const Mesh &other) const;
+
+	/* Create the Embree geometry and attach it to the scene. */
+	void attach(RTCDevice device, RTCScene scene);
+	void detach(RTCScene scene);
+	/* Vertex positions changed in place with the same topology, refit the
+	 * existing BVH of the geometry instead of building a new one. */
+	void refit();
+
+	std::string name;
+
+	std::vector<float3> verts;
+	std::vector<int3> triangles;
+	std::vector<int> shader;
+	std::vector<float3> vertex_normals;
+	bool smooth;
+	/* Per triangle corner, or empty. */
+	std::vector<float2> uvs;
+
+	std::vector<float4> curve_keys;
+	std::vector<int> curve_first_key;
+	std::vector<int> curve_shader;
+	CurveShape curve_shape;
+
+	int motion_steps;
+	std::vector<float3> motion_verts;
+	std::vector<float4> motion_curve_keys;
+
+	unsigned int geom_id;
+	unsigned int curve_geom_id;
+
+	/* Keeps host buffers referenced by the shared pointers alive. */
+	std::shared_ptr<void> shared_owner;
+	/* The shared buffers never change, like a read only file mapping. */
+	bool shared_read_only;
+
+  private:
+	int num_time_steps() const { return has_motion() ? motion_steps : 1; }
+	void set_vertex_buffer();
+	void attach_curves(RTCDevice device, RTCScene scene);
+	void build_curve_segments();
+	void update_curve_bezier();
+	void set_curve_buffers();
+
+	struct SharedBuffer {
+		SharedBuffer(): data(nullptr), stride(0), count(0) {}
+
+		const char *data;
+		size_t stride;
+		size_t count;
+	};
+
+	SharedBuffer shared_verts_;
+	SharedBuffer shared_tris_;
+
+	RTCGeometry rtc_geom_;
+	RTCGeometry rtc_curve_geom_;
+
+	/* First control point of each curve segment and the curve it belongs
+	 * to. Ribbons index the keys, thick curves the Bezier control points,
+	 * 3 per segment plus one per curve, for each motion step in turn. */
+	std::vector<unsigned int> curve_segments_;
+	std::vector<int> segment_curve_;
+	std::vector<float4> curve_bezier_;
+};
+
+} // namespace steam
+
+#endif //__STEAM_MESH_H__
@@ -0,0 +1,95 @@
+#include <iostream>
+#include <string>
+
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+
+#include "steam_lib/renderer.h"
+
+namespace steam {
+
+static void embree_error_func(void * /*user_ptr*/, RTCError code, const char *str) {
+	std::cerr << "Embree error " << code << ": " << (str ? str : "") << std::endl;
+}
+
+SteamRenderer::SteamRenderer(): device_(nullptr), threads_(0), samples_(0), tiles_done_(0), cancel_(false) {
+
+}
+
+SteamRenderer::~SteamRenderer() {
+	scene_.reset();
+	if (device_)
+		rtcReleaseDevice(device_);
+}
+
+bool SteamRenderer::init(int threads) {
+	if (device_)
+		return true;
+
+	threads_ = (threads > 0) ? threads : tbb::this_task_arena::max_concurrency();
+
+	std::string config = "threads=" + std::to_string(threads_);
+	device_ = rtcNewDevice(config.c_str());
+	if (!device_) {
+		std::cerr << "Unable to create Embree device" << std::endl;
+		return false;
+	}
+	rtcSetDeviceErrorFunction(device_, embree_error_func, nullptr);
+
+	arena_.reset(new tbb::task_arena(threads_));
+	scene_.reset(new Scene(device_));
+
+	return true;
+}
+
+void SteamRenderer::set_resolution(int width, int height) {
+	if (width != film_.width() || height != film_.height())
+		film_.resize(width, height);
+}
+
+void SteamRenderer::render(int samples) {
+	if (!device_ || film_.width() <= 0 || film_.height() <= 0)
+		return;
+
+	cancel_ = false;
+	tiles_done_ = 0;
+	samples_ = 0;
+
+	Scene *scene = scene_.get();
+	scene->camera.width = film_.width();
+	scene->camera.height = film_.height();
+	scene->camera.update();
+
+	arena_->execute([&] { scene->commit(); });
+
+	film_.reset();
+	tile_manager_.reset(film_.width(), film_.height());
+
+	std::unique_ptr<const PathTracer> tracer(PathTracer::create(scene, params));
+	const std::vector<Tile> &tiles = tile_manager_.tiles;
+
+	arena_->execute([&] {
+		tbb::parallel_for(tbb::blocked_range<size_t>(0, tiles.size(), 1), [&](const tbb::blocked_range<size_t> &r) {
+			for (size_t i = r.begin(); i != r.end(); i++) {
+				if (cancel_)
+					return;
+
+				tracer->render_tile(tiles[i], &film_, 0, samples);
+				tiles_done_++;
+			}
+		});
+	});
+
+	samples_ = samples;
+}
+
+float SteamRenderer::progress() const {
+	const size_t num_tiles = tile_manager_.tiles.size();
+	return (num_tiles) ? (float)tiles_done_ / (float)num_tiles : 0.0f;
+}
+
+void SteamRenderer::get_pixels(float *rgba) const {
+	film_.get_pixels(rgba, samples_);
+}
+
+} // namespace steam
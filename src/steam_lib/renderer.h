@@ -0,0 +1,67 @@
+#ifndef __STEAM_RENDERER_H__
+#define __STEAM_RENDERER_H__
+
+#include <atomic>
+#include <memory>
+
+#include <embree3/rtcore.h>
+#include <tbb/task_arena.h>
+
+#include "steam_lib/film.h"
+#include "steam_lib/geometry_cache.h"
+#include "steam_lib/integrator.h"
+#include "steam_lib/scene.h"
+#include "steam_lib/tile.h"
+
+namespace steam {
+
+/* CPU render engine: owns the Embree device, the scene and the film, and
+ * renders tiles in parallel on a TBB task arena. */
+
+class SteamRenderer {
+  public:
+	SteamRenderer();
+	~SteamRenderer();
+
+	/* Create the Embree device and worker arena, threads <= 0 uses all cores. */
+	bool init(int threads = 0);
+	bool is_initialized() const { return device_ != nullptr; }
+
+	Scene *scene() { return scene_.get(); }
+
+	void set_resolution(int width, int height);
+	int width() const { return film_.width(); }
+	int height() const { return film_.height(); }
+	int num_threads() const { return threads_; }
+
+	/* Render the given number of samples, blocks until done or cancelled. */
+	void render(int samples);
+	void cancel() { cancel_ = true; }
+	bool is_cancelled() const { return cancel_; }
+
+	/* Fraction of tiles finished in the current render. */
+	float progress() const;
+
+	/* Averaged RGBA pixels, bottom to top, width * height * 4 floats. */
+	void get_pixels(float *rgba) const;
+
+	IntegratorParams params;
+	/* Disabled until a directory is set. */
+	GeometryCache geometry_cache;
+
+  private:
+	RTCDevice device_;
+	std::unique_ptr<Scene> scene_;
+	std::unique_ptr<tbb::task_arena> arena_;
+	Film film_;
+	TileManager tile_manager_;
+	int threads_;
+	int samples_;
+
+	std::atomic<int> tiles_done_;
+	std::atomic<bool> cancel_;
+};
+
+} // namespace steam
+
+#endif //__STEAM_RENDERER_H__
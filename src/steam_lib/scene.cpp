@@ -0,0 +1,453 @@
+#include <algorithm>
+
+#include <embree3/rtcore_quaternion.h>
+
+#include "steam_lib/scene.h"
+
+namespace steam {
+
+/* Split an affine transform into translation, rotation and the upper
+ * triangular scale and skew matrix of Embree's quaternion decomposition,
+ * from a Gram-Schmidt QR of the 3x3 part. Mirroring ends up in scale_z. */
+static RTCQuaternionDecomposition transform_decompose(const Transform &tfm) {
+	const float3 c0 = transform_get_column(tfm, 0);
+	const float3 c1 = transform_get_column(tfm, 1);
+	const float3 c2 = transform_get_column(tfm, 2);
+	const float3 t = transform_get_column(tfm, 3);
+
+	RTCQuaternionDecomposition qd;
+	rtcInitQuaternionDecomposition(&qd);
+
+	float3 q0 = make_float3(1.0f, 0.0f, 0.0f), q1, q2;
+	const float sx = len(c0);
+	if (sx > 0.0f)
+		q0 = c0 / sx;
+
+	const float skew_xy = dot(q0, c1);
+	const float3 u1 = c1 - q0 * skew_xy;
+	const float sy = len(u1);
+	if (sy > 0.0f)
+		q1 = u1 / sy;
+	else
+		make_orthonormals(q0, &q1, &q2);
+
+	q2 = cross(q0, q1);
+	const float skew_xz = dot(q0, c2);
+	const float skew_yz = dot(q1, c2);
+	const float sz = dot(q2, c2);
+
+	rtcQuaternionDecompositionSetScale(&qd, sx, sy, sz);
+	rtcQuaternionDecompositionSetSkew(&qd, skew_xy, skew_xz, skew_yz);
+	rtcQuaternionDecompositionSetTranslation(&qd, t.x, t.y, t.z);
+
+	/* Rotation matrix with columns q0, q1, q2 to a unit quaternion. */
+	const float m00 = q0.x, m10 = q0.y, m20 = q0.z;
+	const float m01 = q1.x, m11 = q1.y, m21 = q1.z;
+	const float m02 = q2.x, m12 = q2.y, m22 = q2.z;
+	const float trace = m00 + m11 + m22;
+	float r, i, j, k;
+
+	if (trace > 0.0f) {
+		const float s = 0.5f / sqrtf(trace + 1.0f);
+		r = 0.25f / s;
+		i = (m21 - m12) * s;
+		j = (m02 - m20) * s;
+		k = (m10 - m01) * s;
+	}
+	else if (m00 > m11 && m00 > m22) {
+		const float s = 2.0f * sqrtf(1.0f + m00 - m11 - m22);
+		r = (m21 - m12) / s;
+		i = 0.25f * s;
+		j = (m01 + m10) / s;
+		k = (m02 + m20) / s;
+	}
+	else if (m11 > m22) {
+		const float s = 2.0f * sqrtf(1.0f + m11 - m00 - m22);
+		r = (m02 - m20) / s;
+		i = (m01 + m10) / s;
+		j = 0.25f * s;
+		k = (m12 + m21) / s;
+	}
+	else {
+		const float s = 2.0f * sqrtf(1.0f + m22 - m00 - m11);
+		r = (m10 - m01) / s;
+		i = (m02 + m20) / s;
+		j = (m12 + m21) / s;
+		k = 0.25f * s;
+	}
+
+	rtcQuaternionDecompositionSetQuaternion(&qd, r, i, j, k);
+	return qd;
+}
+
+/* One decomposition per time step, the quaternions are kept in the same
+ * hemisphere so the interpolation takes the short way around. */
+static void set_geometry_motion(RTCGeometry geom, const std::vector<Transform> &motion) {
+	rtcSetGeometryTimeStepCount(geom, (unsigned int)motion.size());
+
+	RTCQuaternionDecomposition prev;
+	for (size_t step = 0; step < motion.size(); step++) {
+		RTCQuaternionDecomposition qd = transform_decompose(motion[step]);
+
+		if (step > 0 && qd.quaternion_r * prev.quaternion_r + qd.quaternion_i * prev.quaternion_i +
+		                        qd.quaternion_j * prev.quaternion_j + qd.quaternion_k * prev.quaternion_k < 0.0f) {
+			rtcQuaternionDecompositionSetQuaternion(&qd, -qd.quaternion_r, -qd.quaternion_i, -qd.quaternion_j, -qd.quaternion_k);
+		}
+
+		rtcSetGeometryTransformQuaternion(geom, (unsigned int)step, &qd);
+		prev = qd;
+	}
+}
+
+Scene::Scene(RTCDevice device): background(make_float3(0.05f)), device_(device), rtc_scene_(nullptr), dynamic_(false), need_commit_(true) {
+	rtcRetainDevice(device_);
+
+	/* Shader 0 is the default surface. */
+	shaders.push_back(Shader());
+}
+
+Scene::~Scene() {
+	clear();
+	clear_geometry_cache();
+	rtcReleaseDevice(device_);
+}
+
+void Scene::clear() {
+	for (size_t i = 0; i < meshes.size(); i++) {
+		/* Merged meshes are owned by the index they were merged into. */
+		if (mesh_source_[i] != (int)i)
+			continue;
+
+		Mesh *mesh = meshes[i];
+
+		/* Hash again here, the mesh may have been deformed since it was added. */
+		if (i < prototypes_.size() && prototypes_[i] && !mesh->has_mutable_buffers()) {
+			prototype_cache_.emplace(mesh->content_hash(), CachedPrototype{mesh, prototypes_[i]});
+			prototypes_[i] = nullptr;
+			continue;
+		}
+
+		delete mesh;
+	}
+
+	meshes.clear();
+	mesh_source_.clear();
+	mesh_hash_map_.clear();
+	lights.clear();
+	for (Volume *volume: volumes)
+		delete volume;
+	volumes.clear();
+	textures.clear();
+	instance_mesh.clear();
+	instance_tfm.clear();
+	instance_motion.clear();
+	shaders.resize(1);
+	geom_id_map_.clear();
+	instance_id_map_.clear();
+	direct_id_map_.clear();
+	instance_geom_id_.clear();
+	updated_instances_.clear();
+	deformed_meshes_.clear();
+
+	if (rtc_scene_) {
+		rtcReleaseScene(rtc_scene_);
+		rtc_scene_ = nullptr;
+	}
+	release_prototypes();
+
+	need_commit_ = true;
+}
+
+void Scene::clear_geometry_cache() {
+	for (auto &it: prototype_cache_) {
+		rtcReleaseScene(it.second.prototype);
+		delete it.second.mesh;
+	}
+	prototype_cache_.clear();
+}
+
+void Scene::release_prototypes() {
+	for (RTCScene prototype: prototypes_) {
+		if (prototype)
+			rtcReleaseScene(prototype);
+	}
+	prototypes_.clear();
+}
+
+int Scene::add_mesh(Mesh *mesh, bool deduplicate) {
+	const int index = (int)meshes.size();
+
+	if (mesh->has_mutable_buffers()) {
+		meshes.push_back(mesh);
+		mesh_source_.push_back(index);
+		need_commit_ = true;
+		return index;
+	}
+
+	const uint64_t hash = mesh->content_hash();
+
+	/* Same content as a mesh added before, share it under a new index. */
+	if (deduplicate) {
+		auto range = mesh_hash_map_.equal_range(hash);
+		for (auto it = range.first; it != range.second; ++it) {
+			if (meshes[it->second]->same_content(*mesh)) {
+				delete mesh;
+				meshes.push_back(meshes[it->second]);
+				mesh_source_.push_back(it->second);
+				need_commit_ = true;
+				return index;
+			}
+		}
+	}
+
+	/* Same content as a prototype of the previous frame, keep its BVH. */
+	RTCScene prototype = nullptr;
+	auto cached = prototype_cache_.equal_range(hash);
+	for (auto it = cached.first; it != cached.second; ++it) {
+		if (it->second.mesh->same_content(*mesh)) {
+			it->second.mesh->name = mesh->name;
+			delete mesh;
+			mesh = it->second.mesh;
+			prototype = it->second.prototype;
+			prototype_cache_.erase(it);
+			break;
+		}
+	}
+
+	meshes.push_back(mesh);
+	mesh_source_.push_back(index);
+	if (deduplicate)
+		mesh_hash_map_.emplace(hash, index);
+	prototypes_.resize(meshes.size(), nullptr);
+	prototypes_[index] = prototype;
+	need_commit_ = true;
+	return index;
+}
+
+int Scene::add_shader(const Shader &shader) {
+	shaders.push_back(shader);
+	return (int)shaders.size() - 1;
+}
+
+void Scene::add_light(const Light &light) {
+	lights.push_back(light);
+}
+
+int Scene::add_volume(Volume *volume) {
+	volumes.push_back(volume);
+	return (int)volumes.size() - 1;
+}
+
+void Scene::add_instance(int mesh, const Transform &tfm) {
+	instance_mesh.push_back(mesh);
+	instance_tfm.push_back(tfm);
+	instance_motion.emplace_back();
+	need_commit_ = true;
+}
+
+void Scene::add_instance(int mesh, const std::vector<Transform> &motion) {
+	if (motion.size() < 2) {
+		add_instance(mesh, motion.empty() ? transform_identity() : motion[0]);
+		return;
+	}
+
+	instance_mesh.push_back(mesh);
+	instance_tfm.push_back(motion[motion.size() / 2]);
+	instance_motion.push_back(motion);
+	need_commit_ = true;
+}
+
+void Scene::set_dynamic(bool dynamic) {
+	if (dynamic_ != dynamic) {
+		dynamic_ = dynamic;
+		need_commit_ = true;
+	}
+}
+
+void Scene::set_instance_transform(size_t instance, const Transform &tfm) {
+	instance_tfm[instance] = tfm;
+
+	/* Dropping the time steps of an instance needs a rebuild. */
+	if (!instance_motion[instance].empty()) {
+		instance_motion[instance].clear();
+		need_commit_ = true;
+		return;
+	}
+
+	updated_instances_.push_back(instance);
+}
+
+void Scene::tag_mesh_deformed(int mesh) {
+	mesh = mesh_source_[mesh];
+
+	for (auto it = mesh_hash_map_.begin(); it != mesh_hash_map_.end(); ++it) {
+		if (it->second == mesh) {
+			mesh_hash_map_.erase(it);
+			break;
+		}
+	}
+
+	if (std::find(deformed_meshes_.begin(), deformed_meshes_.end(), mesh) == deformed_meshes_.end())
+		deformed_meshes_.push_back(mesh);
+}
+
+void Scene::update() {
+	for (int index: deformed_meshes_) {
+		meshes[index]->refit();
+
+		/* Instances have to pick up the refit prototype as well. */
+		if (prototypes_[index]) {
+			rtcCommitScene(prototypes_[index]);
+			for (size_t i = 0; i < instance_mesh.size(); i++) {
+				if (mesh_source_[instance_mesh[i]] == index)
+					rtcCommitGeometry(rtcGetGeometry(rtc_scene_, instance_geom_id_[i]));
+			}
+			for (size_t inst_id = 0; inst_id < direct_id_map_.size(); inst_id++) {
+				if (direct_id_map_[inst_id] == index)
+					rtcCommitGeometry(rtcGetGeometry(rtc_scene_, (unsigned int)inst_id));
+			}
+		}
+	}
+
+	for (size_t i: updated_instances_) {
+		RTCGeometry geom = rtcGetGeometry(rtc_scene_, instance_geom_id_[i]);
+		rtcSetGeometryTransform(geom, 0, RTC_FORMAT_FLOAT3X4_ROW_MAJOR, &instance_tfm[i]);
+		rtcCommitGeometry(geom);
+	}
+
+	rtcCommitScene(rtc_scene_);
+
+	updated_instances_.clear();
+	deformed_meshes_.clear();
+}
+
+void Scene::commit() {
+	if (!need_commit_ && rtc_scene_) {
+		if (!updated_instances_.empty() || !deformed_meshes_.empty())
+			update();
+		return;
+	}
+
+	if (rtc_scene_)
+		rtcReleaseScene(rtc_scene_);
+
+	/* A dynamic scene gets a two level BVH over per geometry BVHs, so changes
+	 * only refit or rebuild the geometry they touch. */
+	rtc_scene_ = rtcNewScene(device_);
+	rtcSetSceneFlags(rtc_scene_, dynamic_ ? RTC_SCENE_FLAG_DYNAMIC : RTC_SCENE_FLAG_NONE);
+	rtcSetSceneBuildQuality(rtc_scene_, dynamic_ ? RTC_BUILD_QUALITY_LOW : RTC_BUILD_QUALITY_HIGH);
+
+	geom_id_map_.clear();
+	instance_id_map_.clear();
+	direct_id_map_.clear();
+	instance_geom_id_.clear();
+	updated_instances_.clear();
+
+	/* Meshes with instances get a prototype scene. Those are only built
+	 * once and kept across commits, meshes deformed since are refit. An
+	 * index without instances draws its mesh directly, so a mesh merged
+	 * under several indices can be both. */
+	prototypes_.resize(meshes.size(), nullptr);
+	std::vector<bool> has_instances(meshes.size(), false);
+	for (int index: instance_mesh)
+		has_instances[index] = true;
+
+	std::vector<bool> instanced(meshes.size(), false), direct(meshes.size(), false);
+	for (size_t i = 0; i < meshes.size(); i++) {
+		if (has_instances[i])
+			instanced[mesh_source_[i]] = true;
+		else
+			direct[mesh_source_[i]] = true;
+	}
+
+	for (size_t i = 0; i < meshes.size(); i++) {
+		if (!instanced[i] && prototypes_[i]) {
+			rtcReleaseScene(prototypes_[i]);
+			prototypes_[i] = nullptr;
+		}
+	}
+
+	for (int index: deformed_meshes_) {
+		if (prototypes_[index]) {
+			meshes[index]->refit();
+			rtcCommitScene(prototypes_[index]);
+		}
+	}
+	deformed_meshes_.clear();
+
+	for (int index: instance_mesh) {
+		const int source = mesh_source_[index];
+		if (prototypes_[source])
+			continue;
+
+		RTCScene prototype = rtcNewScene(device_);
+		rtcSetSceneBuildQuality(prototype, RTC_BUILD_QUALITY_HIGH);
+		meshes[source]->attach(device_, prototype);
+		rtcCommitScene(prototype);
+		prototypes_[source] = prototype;
+	}
+
+	for (size_t i = 0; i < meshes.size(); i++) {
+		if (mesh_source_[i] != (int)i || !direct[i])
+			continue;
+
+		/* The Embree geometry of a mesh is in its prototype already, draw
+		 * it directly through an instance without transform. */
+		if (prototypes_[i]) {
+			const Transform identity = transform_identity();
+			RTCGeometry geom = rtcNewGeometry(device_, RTC_GEOMETRY_TYPE_INSTANCE);
+			rtcSetGeometryInstancedScene(geom, prototypes_[i]);
+			rtcSetGeometryTransform(geom, 0, RTC_FORMAT_FLOAT3X4_ROW_MAJOR, &identity);
+			rtcCommitGeometry(geom);
+
+			const unsigned int inst_id = rtcAttachGeometry(rtc_scene_, geom);
+			rtcReleaseGeometry(geom);
+
+			if (direct_id_map_.size() <= inst_id)
+				direct_id_map_.resize(inst_id + 1, -1);
+			direct_id_map_[inst_id] = (int)i;
+			continue;
+		}
+
+		Mesh *mesh = meshes[i];
+		mesh->attach(device_, rtc_scene_);
+
+		/* Triangles and curves are separate geometries of the same mesh. */
+		for (unsigned int geom_id: {mesh->geom_id, mesh->curve_geom_id}) {
+			if (geom_id == RTC_INVALID_GEOMETRY_ID)
+				continue;
+
+			if (geom_id_map_.size() <= geom_id)
+				geom_id_map_.resize(geom_id + 1, nullptr);
+			geom_id_map_[geom_id] = mesh;
+		}
+	}
+
+	/* Instances only hold a reference to the prototype and a transform. */
+	for (size_t i = 0; i < instance_mesh.size(); i++) {
+		RTCGeometry geom = rtcNewGeometry(device_, RTC_GEOMETRY_TYPE_INSTANCE);
+		rtcSetGeometryInstancedScene(geom, prototypes_[mesh_source_[instance_mesh[i]]]);
+		if (instance_motion[i].empty())
+			rtcSetGeometryTransform(geom, 0, RTC_FORMAT_FLOAT3X4_ROW_MAJOR, &instance_tfm[i]);
+		else
+			set_geometry_motion(geom, instance_motion[i]);
+		rtcCommitGeometry(geom);
+
+		const unsigned int inst_id = rtcAttachGeometry(rtc_scene_, geom);
+		rtcReleaseGeometry(geom);
+		instance_geom_id_.push_back(inst_id);
+
+		if (instance_id_map_.size() <= inst_id)
+			instance_id_map_.resize(inst_id + 1, -1);
+		instance_id_map_[inst_id] = (int)i;
+	}
+
+	/* Embree builds the BVH in parallel on its own TBB task arena. */
+	rtcCommitScene(rtc_scene_);
+	need_commit_ = false;
+
+	/* Prototypes of the previous frame that were not added again. */
+	clear_geometry_cache();
+}
+
+} // namespace steam
@@ -0,0 +1,164 @@
+#ifndef __STEAM_SCENE_H__
+#define __STEAM_SCENE_H__
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include <embree3/rtcore.h>
+
+#include "steam_lib/camera.h"
+#include "steam_lib/light.h"
+#include "steam_lib/mesh.h"
+#include "steam_lib/shader.h"
+#include "steam_lib/texture.h"
+#include "steam_lib/util_math.h"
+#include "steam_lib/volume.h"
+
+namespace steam {
+
+/* Render scene: geometry, shaders, lights and camera, plus the Embree scene
+ * built from them. The scene owns its meshes.
+ *
+ * Meshes are attached to the top level Embree scene directly, unless they
+ * have instances. Those are built once into a prototype scene of their own,
+ * referenced by one Embree instance geometry per instance, and are only drawn
+ * through their instances.
+ *
+ * After the first commit, instance transforms and in place vertex changes are
+ * applied incrementally: only the affected geometry BVHs are refit and the top
+ * level scene is committed again. With set_dynamic() the top level scene is
+ * built for fast updates, which suits viewport rendering.
+ *
+ * Instances can have a transform per motion step, spread evenly over the
+ * shutter like mesh motion steps. Embree interpolates those as quaternion
+ * decompositions, so spinning instances keep their shape between steps.
+ *
+ * Meshes are deduplicated by content: adding a mesh identical to one already
+ * in the scene returns a new index sharing the existing mesh, so instances of
+ * both share one prototype BVH. Each index keeps its own role, when one is
+ * drawn directly and the other instanced the prototype is drawn directly as
+ * well, through an instance without transform. Prototypes also survive clear(), for animation renders that
+ * sync the same geometry every frame: a mesh added again with the same content
+ * picks up its previous BVH, prototypes not reused by the next commit are
+ * released. Meshes referencing host buffers are never merged or cached, their
+ * content can change without the scene knowing. Meshes loaded from the
+ * geometry cache map read only files and are merged like any other. Meshes that will be deformed
+ * should be added without deduplication, otherwise deforming one moves every
+ * object merged into it.
+ *
+ * Volumes are not part of the Embree scene, there are few of them and the
+ * integrator clips rays against their bounds directly. */
+
+class Scene {
+  public:
+	Scene(RTCDevice device);
+	~Scene();
+
+	/* Remove all scene data, prototypes are kept for the next frame. */
+	void clear();
+	void clear_geometry_cache();
+
+	/* Takes ownership of the mesh and returns its index. With deduplicate
+	 * and an existing mesh with the same content, the mesh passed in is
+	 * deleted and the new index refers to the existing one. */
+	int add_mesh(Mesh *mesh, bool deduplicate = true);
+	int add_shader(const Shader &shader);
+	void add_light(const Light &light);
+	/* Takes ownership of the volume and returns its index. */
+	int add_volume(Volume *volume);
+	/* Add an instance of meshes[mesh] with an object to world transform. */
+	void add_instance(int mesh, const Transform &tfm);
+	/* Same with a transform per motion step, an odd number of them. */
+	void add_instance(int mesh, const std::vector<Transform> &motion);
+
+	/* Changing this rebuilds the scene on the next commit. */
+	void set_dynamic(bool dynamic);
+	bool is_dynamic() const { return dynamic_; }
+
+	/* Updates that do not change topology, cheaper than adding again. A new
+	 * transform replaces the motion of an instance. */
+	void set_instance_transform(size_t instance, const Transform &tfm);
+	/* A deformed mesh is no longer merged with meshes added later. Indices
+	 * sharing the mesh deform with it. */
+	void tag_mesh_deformed(int mesh);
+
+	/* Build the acceleration structure, must be called before rendering
+	 * whenever geometry was added or changed. */
+	void commit();
+
+	RTCScene rtc_scene() const { return rtc_scene_; }
+
+	/* Mesh hit by a ray, from the Embree geometry and instance IDs. For hits
+	 * inside an instance tfm is set to the instance transform, else nullptr.
+	 * With instance motion that is the center step, used for shading only. */
+	const Mesh *find_mesh(unsigned int geom_id, unsigned int inst_id, const Transform **tfm) const {
+		if (inst_id == RTC_INVALID_GEOMETRY_ID) {
+			*tfm = nullptr;
+			return (geom_id < geom_id_map_.size()) ? geom_id_map_[geom_id] : nullptr;
+		}
+		if (inst_id < direct_id_map_.size() && direct_id_map_[inst_id] >= 0) {
+			*tfm = nullptr;
+			return meshes[direct_id_map_[inst_id]];
+		}
+		if (inst_id >= instance_id_map_.size() || instance_id_map_[inst_id] < 0)
+			return nullptr;
+
+		const int instance = instance_id_map_[inst_id];
+		*tfm = &instance_tfm[instance];
+		return meshes[instance_mesh[instance]];
+	}
+
+	const Shader &get_shader(int index) const {
+		return shaders[clamp(index, 0, (int)shaders.size() - 1)];
+	}
+
+	/* Indices merged by deduplication hold the same pointer. */
+	std::vector<Mesh *> meshes;
+	std::vector<Shader> shaders;
+	std::vector<Light> lights;
+	std::vector<Volume *> volumes;
+	TextureCache textures;
+	/* Instances as parallel arrays, mesh index, transform and motion steps.
+	 * The motion is empty for instances that don't move. */
+	std::vector<int> instance_mesh;
+	std::vector<Transform> instance_tfm;
+	std::vector<std::vector<Transform>> instance_motion;
+	float3 background;
+	Camera camera;
+
+  private:
+	void release_prototypes();
+	void update();
+
+	/* Prototype BVH of a previous frame, with the mesh it was built from. */
+	struct CachedPrototype {
+		Mesh *mesh;
+		RTCScene prototype;
+	};
+
+	RTCDevice device_;
+	RTCScene rtc_scene_;
+	std::vector<const Mesh *> geom_id_map_;
+	std::vector<int> instance_id_map_;
+	/* Meshes both instanced and drawn directly, by the instance ID drawing
+	 * them directly. */
+	std::vector<int> direct_id_map_;
+	std::vector<RTCScene> prototypes_;
+	std::vector<unsigned int> instance_geom_id_;
+	std::vector<size_t> updated_instances_;
+	std::vector<int> deformed_meshes_;
+	/* Index owning the mesh of each index, itself unless merged. Prototypes
+	 * are kept at the owning index. */
+	std::vector<int> mesh_source_;
+	/* Meshes that own their data by content hash, and the cached prototypes,
+	 * hash collisions are resolved with Mesh::same_content(). */
+	std::unordered_multimap<uint64_t, int> mesh_hash_map_;
+	std::unordered_multimap<uint64_t, CachedPrototype> prototype_cache_;
+	bool dynamic_;
+	bool need_commit_;
+};
+
+} // namespace steam
+
+#endif //__STEAM_SCENE_H__
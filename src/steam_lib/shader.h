@@ -0,0 +1,29 @@
+#ifndef __STEAM_SHADER_H__
+#define __STEAM_SHADER_H__
+
+#include <string>
+
+#include "steam_lib/util_math.h"
+
+namespace steam {
+
+/* Minimal surface description: a lambertian base color plus emission. The
+ * color is multiplied by an image of the scene texture cache when
+ * color_texture is set, looked up with the UVs of the mesh. */
+
+struct Shader {
+	Shader(): color(make_float3(0.8f)), emission(make_float3(0.0f)), color_texture(-1) {}
+	Shader(const float3 &color_, const float3 &emission_, int color_texture_ = -1)
+	    : color(color_), emission(emission_), color_texture(color_texture_) {}
+
+	bool has_emission() const { return !is_zero(emission); }
+
+	std::string name;
+	float3 color;
+	float3 emission;
+	int color_texture;
+};
+
+} // namespace steam
+
+#endif //__STEAM_SHADER_H__
@@ -0,0 +1,118 @@
+#include <cstdio>
+
+#include <embree3/rtcore.h>
+
+#include "steam_lib/scene.h"
+
+using namespace steam;
+
+static int failures = 0;
+
+#define CHECK(expr) \
+	do { \
+		if (!(expr)) { \
+			fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #expr); \
+			failures++; \
+		} \
+	} while (0)
+
+/* Unit quad in the z = 0 plane, over x and y in [0, 1]. */
+static Mesh *new_quad() {
+	Mesh *mesh = new Mesh();
+	mesh->verts = {make_float3(0.0f, 0.0f, 0.0f), make_float3(1.0f, 0.0f, 0.0f), make_float3(1.0f, 1.0f, 0.0f),
+	               make_float3(0.0f, 1.0f, 0.0f)};
+	mesh->triangles = {make_int3(0, 1, 2), make_int3(0, 2, 3)};
+	return mesh;
+}
+
+/* Mesh hit by a ray straight down through (x, y), nullptr on a miss. */
+static const Mesh *trace_down(const Scene &scene, float x, float y) {
+	RTCIntersectContext context;
+	rtcInitIntersectContext(&context);
+
+	RTCRayHit rayhit;
+	RTCRay &ray = rayhit.ray;
+	ray.org_x = x; ray.org_y = y; ray.org_z = 1.0f;
+	ray.dir_x = 0.0f; ray.dir_y = 0.0f; ray.dir_z = -1.0f;
+	ray.tnear = 0.0f;
+	ray.tfar = 2.0f;
+	ray.time = 0.0f;
+	ray.mask = -1;
+	ray.id = 0;
+	ray.flags = 0;
+	rayhit.hit.geomID = RTC_INVALID_GEOMETRY_ID;
+	rayhit.hit.instID[0] = RTC_INVALID_GEOMETRY_ID;
+
+	rtcIntersect1(scene.rtc_scene(), &context, &rayhit);
+	if (rayhit.hit.geomID == RTC_INVALID_GEOMETRY_ID)
+		return nullptr;
+
+	const Transform *tfm;
+	return scene.find_mesh(rayhit.hit.geomID, rayhit.hit.instID[0], &tfm);
+}
+
+/* Same content added twice, one drawn directly and one instanced: both have
+ * to render, sharing one mesh. */
+static void test_direct_and_instanced(RTCDevice device) {
+	Scene scene(device);
+
+	const int direct = scene.add_mesh(new_quad());
+	const int instanced = scene.add_mesh(new_quad());
+	CHECK(direct != instanced);
+	CHECK(scene.meshes[direct] == scene.meshes[instanced]);
+
+	Transform tfm = transform_identity();
+	tfm.x[3] = 10.0f;
+	scene.add_instance(instanced, tfm);
+	scene.commit();
+
+	CHECK(trace_down(scene, 0.5f, 0.5f) == scene.meshes[direct]);
+	CHECK(trace_down(scene, 10.5f, 0.5f) == scene.meshes[instanced]);
+	CHECK(trace_down(scene, 5.5f, 0.5f) == nullptr);
+
+	/* Moving the instance keeps the direct one in place. */
+	tfm.x[3] = 20.0f;
+	scene.set_instance_transform(0, tfm);
+	scene.commit();
+
+	CHECK(trace_down(scene, 0.5f, 0.5f) == scene.meshes[direct]);
+	CHECK(trace_down(scene, 20.5f, 0.5f) == scene.meshes[instanced]);
+	CHECK(trace_down(scene, 10.5f, 0.5f) == nullptr);
+}
+
+/* Two indices of the same content that are both instanced share one
+ * prototype and nothing is drawn at the origin. */
+static void test_instanced_twice(RTCDevice device) {
+	Scene scene(device);
+
+	const int a = scene.add_mesh(new_quad());
+	const int b = scene.add_mesh(new_quad());
+
+	Transform tfm = transform_identity();
+	tfm.x[3] = 10.0f;
+	scene.add_instance(a, tfm);
+	tfm.x[3] = 20.0f;
+	scene.add_instance(b, tfm);
+	scene.commit();
+
+	CHECK(trace_down(scene, 0.5f, 0.5f) == nullptr);
+	CHECK(trace_down(scene, 10.5f, 0.5f) == scene.meshes[a]);
+	CHECK(trace_down(scene, 20.5f, 0.5f) == scene.meshes[b]);
+}
+
+int main() {
+	RTCDevice device = rtcNewDevice("threads=1");
+	if (!device) {
+		fprintf(stderr, "Unable to create the Embree device\n");
+		return 1;
+	}
+
+	test_direct_and_instanced(device);
+	test_instanced_twice(device);
+
+	rtcReleaseDevice(device);
+
+	if (failures)
+		fprintf(stderr, "%d checks failed\n", failures);
+	return failures ? 1 : 0;
+}
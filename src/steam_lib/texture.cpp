@@ -0,0 +1,482 @@
+#include <cmath>
+#include <cstring>
+
+#include "steam_lib/texture.h"
+#include "steam_lib/texture_blocks.h"
+
+namespace steam {
+
+namespace {
+
+float srgb_to_linear(float c) {
+	if (c < 0.04045f)
+		return (c < 0.0f) ? 0.0f : c * (1.0f / 12.92f);
+	return powf((c + 0.055f) * (1.0f / 1.055f), 2.4f);
+}
+
+float linear_to_srgb(float c) {
+	if (c < 0.0031308f)
+		return (c < 0.0f) ? 0.0f : c * 12.92f;
+	return 1.055f * powf(c, 1.0f / 2.4f) - 0.055f;
+}
+
+/* 8 bit to float, with and without the sRGB transfer function. */
+struct ByteTables {
+	ByteTables() {
+		for (int i = 0; i < 256; i++) {
+			linear[i] = i * (1.0f / 255.0f);
+			srgb[i] = srgb_to_linear(linear[i]);
+		}
+	}
+
+	float linear[256];
+	float srgb[256];
+};
+
+const ByteTables &byte_tables() {
+	static const ByteTables tables;
+	return tables;
+}
+
+inline float4 make_rgba(float r, float g, float b, float a) {
+	return {r, g, b, a};
+}
+
+inline float4 mix(const float4 &a, const float4 &b, float t) {
+	return a * (1.0f - t) + b * t;
+}
+
+/* Convert one row of pixels to RGBA, taking every stride-th pixel. The
+ * channel count is dispatched once per row so each inner loop is straight line
+ * code the compiler vectorizes, this runs for every texel entering the cache. */
+void convert_row(const float *in, int channels, int stride, int w, float4 *out) {
+	const int step = channels * stride;
+	switch (channels) {
+		case 1:
+			for (int i = 0; i < w; i++)
+				out[i] = make_rgba(in[step * i], in[step * i], in[step * i], 1.0f);
+			break;
+		case 2:
+			for (int i = 0; i < w; i++)
+				out[i] = make_rgba(in[step * i], in[step * i], in[step * i], in[step * i + 1]);
+			break;
+		case 3:
+			for (int i = 0; i < w; i++)
+				out[i] = make_rgba(in[step * i], in[step * i + 1], in[step * i + 2], 1.0f);
+			break;
+		default:
+			if (stride == 1) {
+				memcpy(out, in, sizeof(float4) * w);
+				break;
+			}
+			for (int i = 0; i < w; i++)
+				out[i] = make_rgba(in[step * i], in[step * i + 1], in[step * i + 2], in[step * i + 3]);
+			break;
+	}
+}
+
+/* Bytes go through a table for sRGB, alpha is always linear. */
+void convert_row(const uint8_t *in, int channels, int stride, int w, const float *table, float4 *out) {
+	const float *alpha = byte_tables().linear;
+	const int step = channels * stride;
+	switch (channels) {
+		case 1:
+			for (int i = 0; i < w; i++)
+				out[i] = make_rgba(table[in[step * i]], table[in[step * i]], table[in[step * i]], 1.0f);
+			break;
+		case 2:
+			for (int i = 0; i < w; i++)
+				out[i] = make_rgba(table[in[step * i]], table[in[step * i]], table[in[step * i]], alpha[in[step * i + 1]]);
+			break;
+		case 3:
+			for (int i = 0; i < w; i++)
+				out[i] = make_rgba(table[in[step * i]], table[in[step * i + 1]], table[in[step * i + 2]], 1.0f);
+			break;
+		default:
+			for (int i = 0; i < w; i++)
+				out[i] = make_rgba(table[in[step * i]], table[in[step * i + 1]], table[in[step * i + 2]],
+				                   alpha[in[step * i + 3]]);
+			break;
+	}
+}
+
+/* Wrap a texel coordinate into [0, size). */
+inline int wrap(int x, int size) {
+	x %= size;
+	return (x < 0) ? x + size : x;
+}
+
+} // namespace
+
+MemoryImageSource::MemoryImageSource(const void *pixels, int width, int height, int channels, bool is_float, bool srgb,
+                                     std::shared_ptr<void> owner)
+    : pixels_(pixels), width_(width), height_(height), channels_(channels), is_float_(is_float), srgb_(srgb && !is_float),
+      owner_(owner) {
+
+}
+
+void MemoryImageSource::read(int x, int y, int w, int h, int stride_x, int stride_y, float4 *rgba) const {
+	const ByteTables &tables = byte_tables();
+	const float *color_table = srgb_ ? tables.srgb : tables.linear;
+
+	for (int row = 0; row < h; row++) {
+		const size_t offset = ((size_t)(y + row * stride_y) * width_ + x) * channels_;
+		float4 *out = rgba + (size_t)row * w;
+
+		if (is_float_)
+			convert_row((const float *)pixels_ + offset, channels_, stride_x, w, out);
+		else
+			convert_row((const uint8_t *)pixels_ + offset, channels_, stride_x, w, color_table, out);
+	}
+}
+
+TextureCache::TextureCache(): memory_limit_((size_t)1 << 30) {
+
+}
+
+int TextureCache::add_image(const std::string &name, ImageSource *source, TextureCompression compression) {
+	std::unique_ptr<Image> image(new Image());
+	image->name = name;
+	image->source.reset(source);
+	image->compression = compression;
+
+	int w = std::max(source->width(), 1), h = std::max(source->height(), 1);
+	for (;;) {
+		image->level_width.push_back(w);
+		image->level_height.push_back(h);
+		if (w == 1 && h == 1)
+			break;
+		w = std::max(w >> 1, 1);
+		h = std::max(h >> 1, 1);
+	}
+
+	images_.push_back(std::move(image));
+	return (int)images_.size() - 1;
+}
+
+void TextureCache::clear() {
+	for (Shard &shard: shards_) {
+		std::lock_guard<std::mutex> lock(shard.mutex);
+		shard.tiles.clear();
+		shard.lru.clear();
+		shard.memory = 0;
+	}
+	images_.clear();
+}
+
+void TextureCache::set_memory_limit(size_t bytes) {
+	memory_limit_.store(bytes, std::memory_order_relaxed);
+}
+
+size_t TextureCache::memory_used() const {
+	size_t memory = 0;
+	for (Shard &shard: shards_) {
+		std::lock_guard<std::mutex> lock(shard.mutex);
+		memory += shard.memory;
+	}
+	return memory;
+}
+
+TextureCache::TilePtr TextureCache::get_tile(int image, int level, int tx, int ty) const {
+	const uint64_t key = tile_key(image, level, tx, ty);
+	Shard &shard = shards_[(key * 0x9E3779B97F4A7C15ull) >> 60];
+
+	{
+		std::lock_guard<std::mutex> lock(shard.mutex);
+		auto it = shard.tiles.find(key);
+		if (it != shard.tiles.end()) {
+			shard.lru.splice(shard.lru.begin(), shard.lru, it->second.second);
+			return it->second.first;
+		}
+	}
+
+	/* Load without holding the lock. Two threads may load the same tile, the
+	 * first one stays. */
+	TilePtr tile = load_tile(image, level, tx, ty);
+	const size_t tile_bytes = tile->memory();
+	const size_t shard_limit = memory_limit_.load(std::memory_order_relaxed) / NUM_SHARDS;
+
+	std::lock_guard<std::mutex> lock(shard.mutex);
+	auto it = shard.tiles.find(key);
+	if (it != shard.tiles.end())
+		return it->second.first;
+
+	shard.lru.push_front(key);
+	shard.tiles.emplace(key, std::make_pair(tile, shard.lru.begin()));
+	shard.memory += tile_bytes;
+
+	/* The new tile is at the front and never the one evicted. */
+	while (shard.memory > shard_limit && shard.lru.size() > 1) {
+		auto evict = shard.tiles.find(shard.lru.back());
+		shard.memory -= evict->second.first->memory();
+		shard.tiles.erase(evict);
+		shard.lru.pop_back();
+	}
+
+	return tile;
+}
+
+TextureCache::TilePtr TextureCache::load_tile(int image_index, int level, int tx, int ty) const {
+	const Image &image = *images_[image_index];
+	const int w = image.level_width[level], h = image.level_height[level];
+	const int x0 = tx << TILE_LOG2, y0 = ty << TILE_LOG2;
+	const int tw = std::min((int)TILE_SIZE, w - x0), th = std::min((int)TILE_SIZE, h - y0);
+
+	/* Edge tiles are allocated at full size, texels past the image are never
+	 * read as lookups wrap first. */
+	std::shared_ptr<Tile> tile = std::make_shared<Tile>();
+	tile->format = TILE_FLOAT;
+	tile->srgb = false;
+	tile->texels.resize(TILE_SIZE * TILE_SIZE);
+
+	/* Every texel of the level covers a footprint of source texels. Up to
+	 * 4x4 of them, spread evenly over the footprint, are read with one strided
+	 * read per sample position. That is the texel itself for level 0 and an
+	 * exact box filter for levels 1 and 2. Coarser levels are estimated from
+	 * the stratified samples, so a tile costs at most 16 reads of its own size
+	 * at any level, instead of reading all of the image below it. */
+	const int footprint_x = image.level_width[0] / w, footprint_y = image.level_height[0] / h;
+	const int nx = std::min(footprint_x, 4), ny = std::min(footprint_y, 4);
+	const float weight = 1.0f / (nx * ny);
+	std::vector<float4> samples((size_t)tw * th);
+
+	for (int j = 0; j < ny; j++) {
+		for (int i = 0; i < nx; i++) {
+			const int sx = x0 * footprint_x + (2 * i + 1) * footprint_x / (2 * nx);
+			const int sy = y0 * footprint_y + (2 * j + 1) * footprint_y / (2 * ny);
+			image.source->read(sx, sy, tw, th, footprint_x, footprint_y, samples.data());
+
+			for (int y = 0; y < th; y++) {
+				float4 *dst = &tile->texels[(size_t)y * TILE_SIZE];
+				const float4 *src = &samples[(size_t)y * tw];
+				for (int x = 0; x < tw; x++)
+					dst[x] = dst[x] + src[x] * weight;
+			}
+		}
+	}
+
+	compress_tile(image, tw, th, tile.get());
+	return tile;
+}
+
+void TextureCache::compress_tile(const Image &image, int tw, int th, Tile *tile) {
+	if (image.compression == TEXTURE_COMPRESSION_NONE)
+		return;
+
+	/* Repeat the last column and row into the unused part of edge tiles, so
+	 * blocks crossing the image edge are fit to image texels only. */
+	std::vector<float4> &texels = tile->texels;
+	for (int y = 0; y < th; y++)
+		for (int x = tw; x < TILE_SIZE; x++)
+			texels[(size_t)y * TILE_SIZE + x] = texels[(size_t)y * TILE_SIZE + tw - 1];
+	for (int y = th; y < TILE_SIZE; y++)
+		std::copy(texels.begin() + (size_t)(th - 1) * TILE_SIZE, texels.begin() + (size_t)th * TILE_SIZE,
+		          texels.begin() + (size_t)y * TILE_SIZE);
+
+	bool opaque = true;
+	for (const float4 &t: texels)
+		opaque &= (t.w >= 1.0f);
+
+	switch (image.compression) {
+		case TEXTURE_COMPRESSION_COLOR:
+			if (image.source->is_float())
+				tile->format = opaque ? TILE_HDR : TILE_HDR_ALPHA;
+			else
+				tile->format = opaque ? TILE_BC1 : TILE_BC3;
+			break;
+		case TEXTURE_COMPRESSION_SCALAR:
+			tile->format = TILE_BC4;
+			break;
+		default:
+			tile->format = TILE_BC5;
+			break;
+	}
+	tile->srgb = image.source->is_srgb();
+
+	const bool srgb = tile->srgb;
+	auto to_byte_space = [srgb](float c) { return clamp(srgb ? linear_to_srgb(c) : c, 0.0f, 1.0f) * 255.0f; };
+
+	const int blocks_per_row = TILE_SIZE / 4;
+	const size_t bytes = Tile::block_bytes(tile->format);
+	tile->blocks.resize(blocks_per_row * blocks_per_row * bytes);
+
+	for (int by = 0; by < blocks_per_row; by++) {
+		for (int bx = 0; bx < blocks_per_row; bx++) {
+			float4 t[16];
+			for (int i = 0; i < 16; i++)
+				t[i] = texels[(size_t)(4 * by + i / 4) * TILE_SIZE + 4 * bx + i % 4];
+
+			float3 rgb[16];
+			float a[16], r[16], g[16];
+			for (int i = 0; i < 16; i++) {
+				a[i] = t[i].w;
+				r[i] = t[i].x;
+				g[i] = t[i].y;
+			}
+
+			uint8_t *block = &tile->blocks[(by * blocks_per_row + bx) * bytes];
+			switch (tile->format) {
+				case TILE_BC1:
+				case TILE_BC3:
+					/* BC1 endpoints are 8 bit in the space of the source data. */
+					for (int i = 0; i < 16; i++)
+						rgb[i] = make_float3(to_byte_space(t[i].x), to_byte_space(t[i].y), to_byte_space(t[i].z));
+					if (tile->format == TILE_BC3) {
+						encode_bc4(a, block);
+						block += BC4_BLOCK_BYTES;
+					}
+					encode_bc1(rgb, block);
+					break;
+				case TILE_HDR:
+				case TILE_HDR_ALPHA:
+					for (int i = 0; i < 16; i++)
+						rgb[i] = make_float3(t[i].x, t[i].y, t[i].z);
+					if (tile->format == TILE_HDR_ALPHA) {
+						encode_bc4(a, block);
+						block += BC4_BLOCK_BYTES;
+					}
+					encode_hdr(rgb, block);
+					break;
+				case TILE_BC4:
+					encode_bc4(r, block);
+					break;
+				default:
+					encode_bc4(r, block);
+					encode_bc4(g, block + BC4_BLOCK_BYTES);
+					break;
+			}
+		}
+	}
+
+	std::vector<float4>().swap(tile->texels);
+}
+
+size_t TextureCache::Tile::block_bytes(TileFormat format) {
+	switch (format) {
+		case TILE_BC1:
+			return BC1_BLOCK_BYTES;
+		case TILE_BC3:
+			return BC4_BLOCK_BYTES + BC1_BLOCK_BYTES;
+		case TILE_BC4:
+			return BC4_BLOCK_BYTES;
+		case TILE_BC5:
+			return 2 * BC4_BLOCK_BYTES;
+		case TILE_HDR:
+			return HDR_BLOCK_BYTES;
+		case TILE_HDR_ALPHA:
+			return BC4_BLOCK_BYTES + HDR_BLOCK_BYTES;
+		default:
+			return 0;
+	}
+}
+
+void TextureCache::Tile::decode_block(int block, float4 out[16]) const {
+	const uint8_t *data = &blocks[block * block_bytes(format)];
+	float values[16];
+
+	switch (format) {
+		case TILE_BC1:
+		case TILE_BC3: {
+			const ByteTables &tables = byte_tables();
+			if (format == TILE_BC3) {
+				decode_bc4(data, values);
+				data += BC4_BLOCK_BYTES;
+			}
+			decode_bc1(data, srgb ? tables.srgb : tables.linear, out);
+			for (int i = 0; i < 16; i++)
+				out[i].w = (format == TILE_BC3) ? values[i] : 1.0f;
+			break;
+		}
+		case TILE_HDR:
+		case TILE_HDR_ALPHA:
+			if (format == TILE_HDR_ALPHA) {
+				decode_bc4(data, values);
+				data += BC4_BLOCK_BYTES;
+			}
+			decode_hdr(data, out);
+			for (int i = 0; i < 16; i++)
+				out[i].w = (format == TILE_HDR_ALPHA) ? values[i] : 1.0f;
+			break;
+		case TILE_BC4:
+			decode_bc4(data, values);
+			for (int i = 0; i < 16; i++)
+				out[i] = make_rgba(values[i], values[i], values[i], 1.0f);
+			break;
+		default: {
+			/* Rebuild the z of a unit normal stored as color * 2 - 1. */
+			float g[16];
+			decode_bc4(data, values);
+			decode_bc4(data + BC4_BLOCK_BYTES, g);
+			for (int i = 0; i < 16; i++) {
+				const float nx = values[i] * 2.0f - 1.0f, ny = g[i] * 2.0f - 1.0f;
+				const float nz = sqrtf(std::max(1.0f - nx * nx - ny * ny, 0.0f));
+				out[i] = make_rgba(values[i], g[i], nz * 0.5f + 0.5f, 1.0f);
+			}
+			break;
+		}
+	}
+}
+
+float4 TextureCache::texel(int image, int level, int x, int y, TileCursor *cursor) const {
+	const int tx = x >> TILE_LOG2, ty = y >> TILE_LOG2;
+	const uint64_t key = tile_key(image, level, tx, ty);
+	if (key != cursor->key) {
+		cursor->tile = get_tile(image, level, tx, ty);
+		cursor->key = key;
+		cursor->block = -1;
+	}
+
+	const Tile &tile = *cursor->tile;
+	const int lx = x & TILE_MASK, ly = y & TILE_MASK;
+	if (tile.format == TILE_FLOAT)
+		return tile.texels[(size_t)ly * TILE_SIZE + lx];
+
+	const int block = (ly >> 2) * (TILE_SIZE / 4) + (lx >> 2);
+	if (block != cursor->block) {
+		tile.decode_block(block, cursor->texels);
+		cursor->block = block;
+	}
+	return cursor->texels[(ly & 3) * 4 + (lx & 3)];
+}
+
+float4 TextureCache::bilinear(int image, int level, float u, float v) const {
+	const Image &img = *images_[image];
+	const int w = img.level_width[level], h = img.level_height[level];
+
+	const float x = u * w - 0.5f, y = v * h - 0.5f;
+	const float fx = floorf(x), fy = floorf(y);
+	const float tx = x - fx, ty = y - fy;
+	const int x0 = wrap((int)fx, w), x1 = wrap((int)fx + 1, w);
+	const int y0 = wrap((int)fy, h), y1 = wrap((int)fy + 1, h);
+
+	TileCursor cursor;
+	const float4 a = mix(texel(image, level, x0, y0, &cursor), texel(image, level, x1, y0, &cursor), tx);
+	const float4 b = mix(texel(image, level, x0, y1, &cursor), texel(image, level, x1, y1, &cursor), tx);
+	return mix(a, b, ty);
+}
+
+float4 TextureCache::lookup(int image, float u, float v, float width) const {
+	if (image < 0 || image >= (int)images_.size())
+		return make_rgba(1.0f, 0.0f, 1.0f, 1.0f);
+	if (!std::isfinite(u) || !std::isfinite(v))
+		return make_rgba(0.0f, 0.0f, 0.0f, 0.0f);
+
+	/* Keep coordinates small before scaling them to texels. */
+	u -= floorf(u);
+	v -= floorf(v);
+
+	const Image &img = *images_[image];
+	const int num_levels = (int)img.level_width.size();
+	const float texels = width * std::max(img.level_width[0], img.level_height[0]);
+	const float lod = clamp((texels > 1.0f) ? log2f(texels) : 0.0f, 0.0f, (float)(num_levels - 1));
+
+	const int level = std::min((int)lod, num_levels - 1);
+	const float t = lod - level;
+	const float4 fine = bilinear(image, level, u, v);
+	if (t == 0.0f || level + 1 >= num_levels)
+		return fine;
+
+	return mix(fine, bilinear(image, level + 1, u, v), t);
+}
+
+} // namespace steam
@@ -0,0 +1,199 @@
+#ifndef __STEAM_TEXTURE_H__
+#define __STEAM_TEXTURE_H__
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "steam_lib/util_math.h"
+
+namespace steam {
+
+/* Block compression of cached tiles, 4x4 texels per block.
+ *
+ * COLOR: 8 bit images use BC1 blocks, BC3 with BC4 alpha where a tile is not
+ *   opaque, encoded in sRGB space for sRGB images. Float images use a BC6H
+ *   style block with two half float endpoints and 16 interpolation steps,
+ *   plus BC4 alpha where needed.
+ * SCALAR: BC4 of the first channel, for roughness and other masks.
+ * NORMAL: BC5 of the first two channels, blue is rebuilt from a unit normal
+ *   encoded as color * 2 - 1.
+ *
+ * Compressed tiles take 1/9 to 1/32 of the float texels and are decoded
+ * per block on lookup. BC4 and BC5 clamp values to [0, 1]. */
+
+enum TextureCompression {
+	TEXTURE_COMPRESSION_NONE = 0,
+	TEXTURE_COMPRESSION_COLOR = 1,
+	TEXTURE_COMPRESSION_SCALAR = 2,
+	TEXTURE_COMPRESSION_NORMAL = 3,
+};
+
+/* Full resolution texels of an image, read on demand by the texture cache.
+ * read() is called from render threads and must be thread safe. */
+
+class ImageSource {
+  public:
+	virtual ~ImageSource() {}
+
+	virtual int width() const = 0;
+	virtual int height() const = 0;
+	/* Whether the texels come from float data, and from sRGB encoded data,
+	 * which picks the block format for compression. */
+	virtual bool is_float() const { return false; }
+	virtual bool is_srgb() const { return false; }
+
+	/* Read w * h texels as linear RGBA, row by row with row 0 at the bottom
+	 * like Blender stores images. Texel (i, j) of the result is the image
+	 * texel (x + i * stride_x, y + j * stride_y). */
+	virtual void read(int x, int y, int w, int h, int stride_x, int stride_y, float4 *rgba) const = 0;
+};
+
+/* Pixels in host memory, 8 bit or float with 1 to 4 channels. The pixels are
+ * not copied, owner keeps them alive. 8 bit pixels are converted from sRGB
+ * unless they hold non color data. */
+
+class MemoryImageSource : public ImageSource {
+  public:
+	MemoryImageSource(const void *pixels, int width, int height, int channels, bool is_float, bool srgb,
+	                  std::shared_ptr<void> owner);
+
+	int width() const override { return width_; }
+	int height() const override { return height_; }
+	bool is_float() const override { return is_float_; }
+	bool is_srgb() const override { return srgb_; }
+	void read(int x, int y, int w, int h, int stride_x, int stride_y, float4 *rgba) const override;
+
+  private:
+	const void *pixels_;
+	int width_, height_, channels_;
+	bool is_float_;
+	bool srgb_;
+	std::shared_ptr<void> owner_;
+};
+
+/* Tiled, MIP mapped texture cache with a memory budget.
+ *
+ * Images are split into 64x64 texel tiles per MIP level, and a tile is only
+ * created on first access, from the image source alone: coarser levels
+ * filter strided reads of the source instead of the finer levels, so any tile
+ * is cheap to create and lookups at a coarse level touch few source texels.
+ * Tiles are kept in LRU order and the least recently used ones are dropped
+ * once the cache grows past its budget, so scenes with more texture data than
+ * memory render as long as a frame touches a fraction of it.
+ *
+ * The cache is split into shards by tile, each with its own lock and LRU
+ * list, so render threads rarely wait on each other. Tiles are reference
+ * counted and stay valid for a lookup in progress even when evicted. Images
+ * are added while synchronizing the scene, not during a render. */
+
+class TextureCache {
+  public:
+	enum {
+		TILE_LOG2 = 6,
+		TILE_SIZE = 1 << TILE_LOG2,
+		TILE_MASK = TILE_SIZE - 1,
+		NUM_SHARDS = 16,
+	};
+
+	TextureCache();
+
+	/* Takes ownership of the source and returns the image index. */
+	int add_image(const std::string &name, ImageSource *source,
+	              TextureCompression compression = TEXTURE_COMPRESSION_NONE);
+	/* Remove all images and drop their tiles. */
+	void clear();
+
+	size_t num_images() const { return images_.size(); }
+
+	/* Budget for all tiles, the default is 1GB. */
+	void set_memory_limit(size_t bytes);
+	size_t memory_limit() const { return memory_limit_.load(std::memory_order_relaxed); }
+	size_t memory_used() const;
+
+	/* Trilinearly filtered lookup with repeat wrapping. width is the size of
+	 * the filter footprint in UV units, it selects the MIP level. Unknown
+	 * images return magenta. */
+	float4 lookup(int image, float u, float v, float width) const;
+
+  private:
+	struct Image {
+		std::string name;
+		std::unique_ptr<ImageSource> source;
+		TextureCompression compression;
+		/* Resolution of each MIP level, level 0 is the source resolution. */
+		std::vector<int> level_width;
+		std::vector<int> level_height;
+	};
+
+	enum TileFormat {
+		TILE_FLOAT,
+		TILE_BC1,
+		TILE_BC3,
+		TILE_BC4,
+		TILE_BC5,
+		TILE_HDR,
+		TILE_HDR_ALPHA,
+	};
+
+	/* Either float texels or compressed blocks, row by row. */
+	struct Tile {
+		TileFormat format;
+		bool srgb;
+		std::vector<float4> texels;
+		std::vector<uint8_t> blocks;
+
+		static size_t block_bytes(TileFormat format);
+		size_t memory() const { return texels.size() * sizeof(float4) + blocks.size(); }
+		void decode_block(int block, float4 out[16]) const;
+	};
+	typedef std::shared_ptr<const Tile> TilePtr;
+
+	struct Shard {
+		Shard(): memory(0) {}
+
+		std::mutex mutex;
+		/* Most recently used first. */
+		std::list<uint64_t> lru;
+		std::unordered_map<uint64_t, std::pair<TilePtr, std::list<uint64_t>::iterator>> tiles;
+		size_t memory;
+	};
+
+	/* Tile lookups through a cursor remember the last tile and the last
+	 * decoded block, neighbouring texels mostly come from the same ones. */
+	struct TileCursor {
+		TileCursor(): key(~(uint64_t)0), block(-1) {}
+
+		uint64_t key;
+		TilePtr tile;
+		int block;
+		float4 texels[16];
+	};
+
+	static uint64_t tile_key(int image, int level, int tx, int ty) {
+		return ((uint64_t)image << 40) | ((uint64_t)level << 34) | ((uint64_t)ty << 17) | (uint64_t)tx;
+	}
+
+	TilePtr get_tile(int image, int level, int tx, int ty) const;
+	TilePtr load_tile(int image, int level, int tx, int ty) const;
+	/* Replace the float texels of a tile by compressed blocks. */
+	static void compress_tile(const Image &image, int tw, int th, Tile *tile);
+	/* Texel of a level, x and y must be inside the level. */
+	float4 texel(int image, int level, int x, int y, TileCursor *cursor) const;
+	float4 bilinear(int image, int level, float u, float v) const;
+
+	std::vector<std::unique_ptr<Image>> images_;
+	mutable Shard shards_[NUM_SHARDS];
+	/* Set from python while render threads read it. */
+	std::atomic<size_t> memory_limit_;
+};
+
+} // namespace steam
+
+#endif //__STEAM_TEXTURE_H__
@@ -0,0 +1,247 @@
+#include <cstring>
+
+#include "steam_lib/texture_blocks.h"
+
+namespace steam {
+
+namespace {
+
+/* Endpoints on the diagonal of the bounding box that follows the correlation
+ * of the colors, inset by 1/16 of the box like most fast encoders do. */
+void fit_endpoints(const float3 rgb[16], float3 *e0, float3 *e1) {
+	float3 lo = rgb[0], hi = rgb[0], mean = make_float3(0.0f);
+	for (int i = 0; i < 16; i++) {
+		lo = min(lo, rgb[i]);
+		hi = max(hi, rgb[i]);
+		mean += rgb[i];
+	}
+	mean = mean * (1.0f / 16.0f);
+
+	float cov_rg = 0.0f, cov_bg = 0.0f;
+	for (int i = 0; i < 16; i++) {
+		const float3 d = rgb[i] - mean;
+		cov_rg += d.x * d.y;
+		cov_bg += d.z * d.y;
+	}
+
+	const float3 inset = (hi - lo) * (1.0f / 16.0f);
+	lo += inset;
+	hi = hi - inset;
+	if (cov_rg < 0.0f)
+		std::swap(lo.x, hi.x);
+	if (cov_bg < 0.0f)
+		std::swap(lo.z, hi.z);
+
+	*e0 = hi;
+	*e1 = lo;
+}
+
+/* Nearest of steps + 1 evenly spaced points from e0 to e1. */
+int project(const float3 &c, const float3 &e0, const float3 &e1, int steps) {
+	const float3 axis = e1 - e0;
+	const float l2 = len_squared(axis);
+	if (!(l2 > 0.0f))
+		return 0;
+	const float t = dot(c - e0, axis) / l2;
+	return clamp((int)(t * steps + 0.5f), 0, steps);
+}
+
+uint16_t pack_565(const float3 &c) {
+	const int r = clamp((int)(c.x * (31.0f / 255.0f) + 0.5f), 0, 31);
+	const int g = clamp((int)(c.y * (63.0f / 255.0f) + 0.5f), 0, 63);
+	const int b = clamp((int)(c.z * (31.0f / 255.0f) + 0.5f), 0, 31);
+	return (uint16_t)((r << 11) | (g << 5) | b);
+}
+
+float3 unpack_565(uint16_t c) {
+	const int r = (c >> 11) & 31, g = (c >> 5) & 63, b = c & 31;
+	return make_float3((float)((r << 3) | (r >> 2)), (float)((g << 2) | (g >> 4)), (float)((b << 3) | (b >> 2)));
+}
+
+/* Non negative finite floats only, rounded to nearest. */
+uint16_t float_to_half(float f) {
+	if (!(f > 0.0f))
+		return 0;
+	f = std::min(f, 65504.0f);
+
+	uint32_t bits;
+	memcpy(&bits, &f, sizeof(bits));
+	const int exponent = (int)((bits >> 23) & 0xFF) - 127 + 15;
+	const uint32_t mantissa = bits & 0x7FFFFF;
+
+	if (exponent <= 0) {
+		/* Denormal half. */
+		if (exponent < -10)
+			return 0;
+		const int shift = 14 - exponent;
+		return (uint16_t)(((mantissa | 0x800000) + (1u << (shift - 1))) >> shift);
+	}
+
+	/* Rounding may carry into the exponent, which is still correct. */
+	return (uint16_t)((((uint32_t)exponent << 10) | (mantissa >> 13)) + ((mantissa >> 12) & 1));
+}
+
+float half_to_float(uint16_t h) {
+	const uint32_t exponent = (h >> 10) & 0x1F, mantissa = h & 0x3FF;
+	if (exponent == 0)
+		return mantissa * (1.0f / 16777216.0f);
+
+	const uint32_t bits = ((exponent + 112) << 23) | (mantissa << 13);
+	float f;
+	memcpy(&f, &bits, sizeof(f));
+	return f;
+}
+
+} // namespace
+
+void encode_bc1(const float3 rgb[16], uint8_t *block) {
+	float3 e0, e1;
+	fit_endpoints(rgb, &e0, &e1);
+
+	/* Four color mode needs c0 > c1. Equal endpoints select three color mode,
+	 * where index 0 still is c0. */
+	uint16_t c0 = pack_565(e0), c1 = pack_565(e1);
+	if (c0 < c1)
+		std::swap(c0, c1);
+
+	uint32_t indices = 0;
+	if (c0 != c1) {
+		/* Steps from c0 to c1 in the order of the BC1 palette. */
+		static const uint32_t codes[4] = {0, 2, 3, 1};
+		const float3 p0 = unpack_565(c0), p1 = unpack_565(c1);
+		for (int i = 0; i < 16; i++)
+			indices |= codes[project(rgb[i], p0, p1, 3)] << (2 * i);
+	}
+
+	memcpy(block, &c0, 2);
+	memcpy(block + 2, &c1, 2);
+	memcpy(block + 4, &indices, 4);
+}
+
+void decode_bc1(const uint8_t *block, const float *byte_to_linear, float4 texels[16]) {
+	uint16_t c0, c1;
+	uint32_t indices;
+	memcpy(&c0, block, 2);
+	memcpy(&c1, block + 2, 2);
+	memcpy(&indices, block + 4, 4);
+
+	float3 palette[4];
+	palette[0] = unpack_565(c0);
+	palette[1] = unpack_565(c1);
+	if (c0 > c1) {
+		palette[2] = (palette[0] * 2.0f + palette[1]) * (1.0f / 3.0f);
+		palette[3] = (palette[0] + palette[1] * 2.0f) * (1.0f / 3.0f);
+	}
+	else {
+		palette[2] = (palette[0] + palette[1]) * 0.5f;
+		palette[3] = make_float3(0.0f);
+	}
+
+	/* Convert the palette once, texels only pick from it. */
+	float3 linear[4];
+	for (int i = 0; i < 4; i++) {
+		linear[i] = make_float3(byte_to_linear[(int)(palette[i].x + 0.5f)], byte_to_linear[(int)(palette[i].y + 0.5f)],
+		                        byte_to_linear[(int)(palette[i].z + 0.5f)]);
+	}
+
+	for (int i = 0; i < 16; i++) {
+		const float3 &c = linear[(indices >> (2 * i)) & 3];
+		texels[i].x = c.x;
+		texels[i].y = c.y;
+		texels[i].z = c.z;
+	}
+}
+
+void encode_bc4(const float values[16], uint8_t *block) {
+	int v[16];
+	int lo = 255, hi = 0;
+	for (int i = 0; i < 16; i++) {
+		v[i] = (int)(clamp(values[i], 0.0f, 1.0f) * 255.0f + 0.5f);
+		lo = std::min(lo, v[i]);
+		hi = std::max(hi, v[i]);
+	}
+
+	/* Eight value mode with e0 > e1. Step s from e1 to e0 has code 1 for the
+	 * first, 0 for the last and 8 - s in between. */
+	uint64_t indices = 0;
+	if (hi > lo) {
+		for (int i = 0; i < 16; i++) {
+			const int s = ((v[i] - lo) * 7 + (hi - lo) / 2) / (hi - lo);
+			const uint64_t code = (s == 7) ? 0 : (s == 0) ? 1 : 8 - s;
+			indices |= code << (3 * i);
+		}
+	}
+
+	block[0] = (uint8_t)hi;
+	block[1] = (uint8_t)lo;
+	for (int i = 0; i < 6; i++)
+		block[2 + i] = (uint8_t)(indices >> (8 * i));
+}
+
+void decode_bc4(const uint8_t *block, float values[16]) {
+	const float e0 = block[0], e1 = block[1];
+	float palette[8];
+	palette[0] = e0;
+	palette[1] = e1;
+	if (e0 > e1) {
+		for (int k = 2; k < 8; k++)
+			palette[k] = ((8 - k) * e0 + (k - 1) * e1) * (1.0f / 7.0f);
+	}
+	else {
+		for (int k = 2; k < 6; k++)
+			palette[k] = ((6 - k) * e0 + (k - 1) * e1) * (1.0f / 5.0f);
+		palette[6] = 0.0f;
+		palette[7] = 255.0f;
+	}
+
+	uint64_t indices = 0;
+	for (int i = 0; i < 6; i++)
+		indices |= (uint64_t)block[2 + i] << (8 * i);
+
+	for (int i = 0; i < 16; i++)
+		values[i] = palette[(indices >> (3 * i)) & 7] * (1.0f / 255.0f);
+}
+
+void encode_hdr(const float3 rgb[16], uint8_t *block) {
+	float3 c[16];
+	for (int i = 0; i < 16; i++)
+		c[i] = make_float3((rgb[i].x > 0.0f) ? rgb[i].x : 0.0f, (rgb[i].y > 0.0f) ? rgb[i].y : 0.0f,
+		                   (rgb[i].z > 0.0f) ? rgb[i].z : 0.0f);
+
+	float3 e[2];
+	fit_endpoints(c, &e[0], &e[1]);
+
+	/* Pick indices against the endpoints as the decoder will see them. */
+	uint16_t half[6];
+	for (int i = 0; i < 6; i++) {
+		half[i] = float_to_half(e[i / 3][i % 3]);
+		e[i / 3][i % 3] = half_to_float(half[i]);
+	}
+
+	uint64_t indices = 0;
+	for (int i = 0; i < 16; i++)
+		indices |= (uint64_t)project(c[i], e[0], e[1], 15) << (4 * i);
+
+	memcpy(block, half, 12);
+	memcpy(block + 12, &indices, 8);
+}
+
+void decode_hdr(const uint8_t *block, float4 texels[16]) {
+	uint16_t half[6];
+	uint64_t indices;
+	memcpy(half, block, 12);
+	memcpy(&indices, block + 12, 8);
+
+	const float3 e0 = make_float3(half_to_float(half[0]), half_to_float(half[1]), half_to_float(half[2]));
+	const float3 step = (make_float3(half_to_float(half[3]), half_to_float(half[4]), half_to_float(half[5])) - e0) *
+	                    (1.0f / 15.0f);
+
+	for (int i = 0; i < 16; i++) {
+		const float3 c = e0 + step * (float)((indices >> (4 * i)) & 15);
+		texels[i].x = c.x;
+		texels[i].y = c.y;
+		texels[i].z = c.z;
+	}
+}
+
+} // namespace steam
@@ -0,0 +1,40 @@
+#ifndef __STEAM_TEXTURE_BLOCKS_H__
+#define __STEAM_TEXTURE_BLOCKS_H__
+
+#include <cstdint>
+
+#include "steam_lib/util_math.h"
+
+namespace steam {
+
+/* Encoders and decoders for blocks of 4x4 texels, in row order.
+ *
+ * BC1 and BC4 follow the layout GPUs use: BC1 holds two RGB565 endpoints and
+ * 2 bit indices, BC4 two 8 bit endpoints and 3 bit indices. The HDR block is
+ * in the spirit of BC6H, but kept simple for the CPU: two half float RGB
+ * endpoints and 4 bit indices, 20 bytes. Encoders fit the endpoints to the
+ * bounding box of the block, which is fast and good enough for rendering. */
+
+enum {
+	BC1_BLOCK_BYTES = 8,
+	BC4_BLOCK_BYTES = 8,
+	HDR_BLOCK_BYTES = 20,
+};
+
+/* rgb in [0, 255], in the space the texels are stored in. */
+void encode_bc1(const float3 rgb[16], uint8_t *block);
+/* byte_to_linear converts the 8 bit palette to linear floats. Alpha is not
+ * touched. */
+void decode_bc1(const uint8_t *block, const float *byte_to_linear, float4 texels[16]);
+
+/* Values are clamped to [0, 1]. */
+void encode_bc4(const float values[16], uint8_t *block);
+void decode_bc4(const uint8_t *block, float values[16]);
+
+/* Negative and NaN colors are stored as black. Alpha is not touched. */
+void encode_hdr(const float3 rgb[16], uint8_t *block);
+void decode_hdr(const uint8_t *block, float4 texels[16]);
+
+} // namespace steam
+
+#endif //__STEAM_TEXTURE_BLOCKS_H__
@@ -0,0 +1,35 @@
+#ifndef __STEAM_TILE_H__
+#define __STEAM_TILE_H__
+
+#include <algorithm>
+#include <vector>
+
+namespace steam {
+
+struct Tile {
+	int x, y, w, h;
+};
+
+/* Splits the image into tiles which are handed out to worker threads. */
+
+class TileManager {
+  public:
+	TileManager(): tile_size(32) {}
+
+	void reset(int width, int height) {
+		tiles.clear();
+		for (int y = 0; y < height; y += tile_size) {
+			for (int x = 0; x < width; x += tile_size) {
+				Tile tile = {x, y, std::min(tile_size, width - x), std::min(tile_size, height - y)};
+				tiles.push_back(tile);
+			}
+		}
+	}
+
+	int tile_size;
+	std::vector<Tile> tiles;
+};
+
+} // namespace steam
+
+#endif //__STEAM_TILE_H__
@@ -0,0 +1,75 @@
+#ifndef __STEAM_UTIL_HASH_H__
+#define __STEAM_UTIL_HASH_H__
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+namespace steam {
+
+/* 64 bit hash of a block of memory, used to fingerprint geometry content.
+ * Four independent lanes consume 32 bytes per iteration, with the xxHash64
+ * constants and mixing. Not cryptographic: equal hashes still need a full
+ * compare before data is treated as identical. */
+
+inline uint64_t hash_rotl64(uint64_t x, int r) {
+	return (x << r) | (x >> (64 - r));
+}
+
+inline uint64_t hash_round64(uint64_t acc, uint64_t v) {
+	acc += v * 0xC2B2AE3D27D4EB4FULL;
+	acc = hash_rotl64(acc, 31);
+	return acc * 0x9E3779B185EBCA87ULL;
+}
+
+inline uint64_t hash_data(const void *data, size_t size, uint64_t seed = 0) {
+	const unsigned char *p = (const unsigned char *)data;
+	const unsigned char *end = p + size;
+	uint64_t v;
+	uint64_t h;
+
+	if (size >= 32) {
+		uint64_t lanes[4] = {seed + 0x9E3779B185EBCA87ULL + 0xC2B2AE3D27D4EB4FULL,
+		                     seed + 0xC2B2AE3D27D4EB4FULL,
+		                     seed,
+		                     seed - 0x9E3779B185EBCA87ULL};
+
+		for (; end - p >= 32; p += 32) {
+			for (int i = 0; i < 4; i++) {
+				memcpy(&v, p + i * 8, sizeof(v));
+				lanes[i] = hash_round64(lanes[i], v);
+			}
+		}
+
+		h = hash_rotl64(lanes[0], 1) + hash_rotl64(lanes[1], 7) + hash_rotl64(lanes[2], 12) + hash_rotl64(lanes[3], 18);
+		for (int i = 0; i < 4; i++)
+			h = (h ^ hash_round64(0, lanes[i])) * 0x9E3779B185EBCA87ULL + 0x85EBCA77C2B2AE63ULL;
+	}
+	else {
+		h = seed + 0x27D4EB2F165667C5ULL;
+	}
+
+	h += (uint64_t)size;
+
+	for (; end - p >= 8; p += 8) {
+		memcpy(&v, p, sizeof(v));
+		h ^= hash_round64(0, v);
+		h = hash_rotl64(h, 27) * 0x9E3779B185EBCA87ULL + 0x85EBCA77C2B2AE63ULL;
+	}
+	for (; p < end; p++) {
+		h ^= (*p) * 0x27D4EB2F165667C5ULL;
+		h = hash_rotl64(h, 11) * 0x9E3779B185EBCA87ULL;
+	}
+
+	/* Avalanche, so every input bit affects every output bit. */
+	h ^= h >> 33;
+	h *= 0xC2B2AE3D27D4EB4FULL;
+	h ^= h >> 29;
+	h *= 0x165667B19E3779F9ULL;
+	h ^= h >> 32;
+	return h;
+}
+
+} // namespace steam
+
+#endif //__STEAM_UTIL_HASH_H__
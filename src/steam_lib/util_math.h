@@ -0,0 +1,169 @@
+#ifndef __STEAM_UTIL_MATH_H__
+#define __STEAM_UTIL_MATH_H__
+
+#include <cmath>
+#include <cfloat>
+#include <cstdint>
+#include <algorithm>
+
+namespace steam {
+
+#ifndef M_PI_F
+#define M_PI_F (3.1415926535897932f)
+#endif
+#ifndef M_1_PI_F
+#define M_1_PI_F (0.3183098861837067f)
+#endif
+
+/* Small vector types used by the render core. float3 is deliberately kept
+ * 12 bytes so arrays of it can be handed to Embree as FLOAT3 buffers. */
+
+struct float2 {
+	float x, y;
+};
+
+struct float3 {
+	float x, y, z;
+
+	float operator[](int i) const { return (&x)[i]; }
+	float &operator[](int i) { return (&x)[i]; }
+};
+
+/* Curve keys, position and radius, as Embree FLOAT4 buffers expect them. */
+struct float4 {
+	float x, y, z, w;
+};
+
+struct int3 {
+	int x, y, z;
+};
+
+inline float2 make_float2(float x, float y) { return {x, y}; }
+inline float3 make_float3(float x, float y, float z) { return {x, y, z}; }
+inline float3 make_float3(float f) { return {f, f, f}; }
+inline float4 make_float4(const float3 &a, float w) { return {a.x, a.y, a.z, w}; }
+inline int3 make_int3(int x, int y, int z) { return {x, y, z}; }
+
+inline float3 operator+(const float3 &a, const float3 &b) { return {a.x + b.x, a.y + b.y, a.z + b.z}; }
+inline float3 operator-(const float3 &a, const float3 &b) { return {a.x - b.x, a.y - b.y, a.z - b.z}; }
+inline float3 operator-(const float3 &a) { return {-a.x, -a.y, -a.z}; }
+inline float3 operator*(const float3 &a, const float3 &b) { return {a.x * b.x, a.y * b.y, a.z * b.z}; }
+inline float3 operator*(const float3 &a, float f) { return {a.x * f, a.y * f, a.z * f}; }
+inline float3 operator*(float f, const float3 &a) { return {a.x * f, a.y * f, a.z * f}; }
+inline float3 operator/(const float3 &a, float f) { float inv = 1.0f / f; return a * inv; }
+inline float3 &operator+=(float3 &a, const float3 &b) { a = a + b; return a; }
+inline float3 &operator*=(float3 &a, const float3 &b) { a = a * b; return a; }
+inline float3 &operator*=(float3 &a, float f) { a = a * f; return a; }
+inline float4 operator+(const float4 &a, const float4 &b) { return {a.x + b.x, a.y + b.y, a.z + b.z, a.w + b.w}; }
+inline float4 operator-(const float4 &a, const float4 &b) { return {a.x - b.x, a.y - b.y, a.z - b.z, a.w - b.w}; }
+inline float4 operator*(const float4 &a, float f) { return {a.x * f, a.y * f, a.z * f, a.w * f}; }
+inline bool operator==(const float3 &a, const float3 &b) { return a.x == b.x && a.y == b.y && a.z == b.z; }
+inline bool operator!=(const float3 &a, const float3 &b) { return !(a == b); }
+
+inline float dot(const float3 &a, const float3 &b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+inline float3 cross(const float3 &a, const float3 &b) {
+	return {a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x};
+}
+inline float len_squared(const float3 &a) { return dot(a, a); }
+inline float len(const float3 &a) { return sqrtf(dot(a, a)); }
+inline float3 normalize(const float3 &a) {
+	float l = len(a);
+	return (l > 0.0f) ? a / l : a;
+}
+inline float3 min(const float3 &a, const float3 &b) {
+	return {std::min(a.x, b.x), std::min(a.y, b.y), std::min(a.z, b.z)};
+}
+inline float3 max(const float3 &a, const float3 &b) {
+	return {std::max(a.x, b.x), std::max(a.y, b.y), std::max(a.z, b.z)};
+}
+inline float reduce_max(const float3 &a) { return std::max(a.x, std::max(a.y, a.z)); }
+inline bool is_zero(const float3 &a) { return a.x == 0.0f && a.y == 0.0f && a.z == 0.0f; }
+
+inline float clamp(float f, float a, float b) { return std::min(std::max(f, a), b); }
+inline int clamp(int i, int a, int b) { return std::min(std::max(i, a), b); }
+
+/* Build an orthonormal basis around N, used for hemisphere sampling. */
+inline void make_orthonormals(const float3 &N, float3 *a, float3 *b) {
+	if (N.x != N.y || N.x != N.z)
+		*a = make_float3(N.z - N.y, N.x - N.z, N.y - N.x);
+	else
+		*a = make_float3(N.z - N.y, N.x + N.z, -N.y - N.x);
+
+	*a = normalize(*a);
+	*b = cross(N, *a);
+}
+
+/* Affine 3x4 transform, row major: each row holds (rotation | translation). */
+struct Transform {
+	float x[4], y[4], z[4];
+};
+
+inline Transform transform_identity() {
+	Transform t = {{1.0f, 0.0f, 0.0f, 0.0f}, {0.0f, 1.0f, 0.0f, 0.0f}, {0.0f, 0.0f, 1.0f, 0.0f}};
+	return t;
+}
+
+/* Take the upper 3 rows of a row major 4x4 matrix. */
+inline Transform transform_from_matrix(const float m[16]) {
+	Transform t;
+	for (int i = 0; i < 4; i++) {
+		t.x[i] = m[i];
+		t.y[i] = m[4 + i];
+		t.z[i] = m[8 + i];
+	}
+	return t;
+}
+
+inline float3 transform_point(const Transform &t, const float3 &p) {
+	return make_float3(t.x[0] * p.x + t.x[1] * p.y + t.x[2] * p.z + t.x[3],
+	                   t.y[0] * p.x + t.y[1] * p.y + t.y[2] * p.z + t.y[3],
+	                   t.z[0] * p.x + t.z[1] * p.y + t.z[2] * p.z + t.z[3]);
+}
+
+inline float3 transform_direction(const Transform &t, const float3 &d) {
+	return make_float3(t.x[0] * d.x + t.x[1] * d.y + t.x[2] * d.z,
+	                   t.y[0] * d.x + t.y[1] * d.y + t.y[2] * d.z,
+	                   t.z[0] * d.x + t.z[1] * d.y + t.z[2] * d.z);
+}
+
+inline float3 transform_get_column(const Transform &t, int column) {
+	return make_float3(t.x[column], t.y[column], t.z[column]);
+}
+
+/* Transform a normal by the inverse transpose of t, up to scale. Uses the
+ * cofactor matrix so no inverse is needed, the result is not normalized and
+ * flips direction for negative scale. */
+inline float3 transform_normal(const Transform &t, const float3 &n) {
+	const float3 c0 = transform_get_column(t, 0);
+	const float3 c1 = transform_get_column(t, 1);
+	const float3 c2 = transform_get_column(t, 2);
+	return cross(c1, c2) * n.x + cross(c2, c0) * n.y + cross(c0, c1) * n.z;
+}
+
+/* Inverse of an affine transform, false if it is singular. The rows of the
+ * inverse 3x3 part are the cross products of the columns over the determinant. */
+inline bool transform_inverse(const Transform &t, Transform *r_inv) {
+	const float3 c0 = transform_get_column(t, 0);
+	const float3 c1 = transform_get_column(t, 1);
+	const float3 c2 = transform_get_column(t, 2);
+	const float3 r0 = cross(c1, c2);
+	const float det = dot(c0, r0);
+	if (det == 0.0f || !std::isfinite(det))
+		return false;
+
+	const float inv_det = 1.0f / det;
+	const float3 rows[3] = {r0 * inv_det, cross(c2, c0) * inv_det, cross(c0, c1) * inv_det};
+	const float3 T = transform_get_column(t, 3);
+	float *dst[3] = {r_inv->x, r_inv->y, r_inv->z};
+	for (int i = 0; i < 3; i++) {
+		dst[i][0] = rows[i].x;
+		dst[i][1] = rows[i].y;
+		dst[i][2] = rows[i].z;
+		dst[i][3] = -dot(rows[i], T);
+	}
+	return true;
+}
+
+} // namespace steam
+
+#endif //__STEAM_UTIL_MATH_H__
@@ -0,0 +1,70 @@
+#ifndef __STEAM_UTIL_RANDOM_H__
+#define __STEAM_UTIL_RANDOM_H__
+
+#include <cstdint>
+
+namespace steam {
+
+/* Stateless random numbers: every (pixel, sample, dimension) triple hashes to
+ * the same value no matter which thread renders it, so images are identical
+ * across thread counts and tile orders. */
+
+inline uint32_t hash_pcg(uint32_t v) {
+	uint32_t state = v * 747796405u + 2891336453u;
+	uint32_t word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+	return (word >> 22u) ^ word;
+}
+
+inline uint32_t hash_pixel(int x, int y, uint32_t seed) {
+	return hash_pcg(hash_pcg((uint32_t)x + hash_pcg((uint32_t)y)) ^ seed);
+}
+
+inline float hash_to_float(uint32_t h) {
+	return (float)(h >> 8) * (1.0f / 16777216.0f);
+}
+
+/* Sample and dimension are hashed separately, so deep paths never run into
+ * the dimensions of another sample. */
+inline uint32_t hash_sample_dimension(uint32_t rng_hash, int sample, int dimension) {
+	return hash_pcg(rng_hash ^ hash_pcg(hash_pcg((uint32_t)sample) ^ (uint32_t)dimension));
+}
+
+inline float path_rng_1D(uint32_t rng_hash, int sample, int dimension) {
+	return hash_to_float(hash_sample_dimension(rng_hash, sample, dimension));
+}
+
+/* Random numbers for loops with a variable iteration count, like free flight
+ * sampling in volumes. Seeded from one (pixel, sample, dimension) triple so
+ * it stays as deterministic as path_rng_1D. */
+struct RandomSequence {
+	RandomSequence(uint32_t rng_hash, int sample, int dimension)
+	    : state(hash_sample_dimension(rng_hash, sample, dimension)) {}
+
+	float next() {
+		state = hash_pcg(state);
+		return hash_to_float(state);
+	}
+
+	uint32_t state;
+};
+
+/* Dimension offsets for the random numbers consumed per bounce. */
+enum PathRngDimension {
+	PRNG_FILTER_U = 0,
+	PRNG_FILTER_V = 1,
+	PRNG_TIME = 2,
+	PRNG_BASE_NUM = 3,
+
+	PRNG_BSDF_U = 0,
+	PRNG_BSDF_V = 1,
+	PRNG_LIGHT = 2,
+	PRNG_LIGHT_U = 3,
+	PRNG_LIGHT_V = 4,
+	PRNG_TERMINATE = 5,
+	PRNG_VOLUME = 6,
+	PRNG_BOUNCE_NUM = 7,
+};
+
+} // namespace steam
+
+#endif //__STEAM_UTIL_RANDOM_H__
@@ -0,0 +1,189 @@
+#include <cmath>
+#include <limits>
+
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+
+#include "steam_lib/volume.h"
+
+namespace steam {
+
+VolumeGrid::VolumeGrid(): width_(0), height_(0), depth_(0), root_res_(make_int3(0, 0, 0)), background_(0.0f), max_value_(0.0f) {
+
+}
+
+bool VolumeGrid::build(const float *voxels, int width, int height, int depth, float background, float tolerance) {
+	root_.clear();
+	brick_range_.clear();
+	leaves_.clear();
+	width_ = height_ = depth_ = 0;
+	root_res_ = make_int3(0, 0, 0);
+	background_ = background;
+	max_value_ = background;
+
+	if (width <= 0 || height <= 0 || depth <= 0)
+		return false;
+
+	width_ = width;
+	height_ = height;
+	depth_ = depth;
+	root_res_ = make_int3((width + LEAF_MASK) >> LEAF_LOG2, (height + LEAF_MASK) >> LEAF_LOG2, (depth + LEAF_MASK) >> LEAF_LOG2);
+
+	const size_t num_root = (size_t)root_res_.x * root_res_.y * root_res_.z;
+	const size_t row = (size_t)width;
+	const size_t slice = row * height;
+	root_.resize(num_root);
+	brick_range_.resize(num_root);
+
+	/* Mark the bricks that hold anything but background and find their value
+	 * range, one brick row at a time in parallel. The range covers one more
+	 * voxel on each side, which trilinear lookups inside the brick blend in. */
+	tbb::parallel_for(tbb::blocked_range<size_t>(0, num_root / root_res_.x), [&](const tbb::blocked_range<size_t> &r) {
+		for (size_t brick_row = r.begin(); brick_row != r.end(); brick_row++) {
+			const int by = (int)(brick_row % root_res_.y);
+			const int bz = (int)(brick_row / root_res_.y);
+			const int y0 = by << LEAF_LOG2, y1 = std::min(y0 + LEAF_DIM, height);
+			const int z0 = bz << LEAF_LOG2, z1 = std::min(z0 + LEAF_DIM, depth);
+
+			for (int bx = 0; bx < root_res_.x; bx++) {
+				const int x0 = bx << LEAF_LOG2, x1 = std::min(x0 + LEAF_DIM, width);
+				bool active = false;
+
+				for (int z = z0; z < z1; z++) {
+					for (int y = y0; y < y1; y++) {
+						const float *v = voxels + z * slice + y * row;
+						for (int x = x0; x < x1; x++)
+							active |= !(fabsf(v[x] - background) <= tolerance);
+					}
+				}
+
+				float vmin = std::numeric_limits<float>::max();
+				float vmax = -std::numeric_limits<float>::max();
+				for (int z = std::max(z0 - 1, 0); z < std::min(z1 + 1, depth); z++) {
+					for (int y = std::max(y0 - 1, 0); y < std::min(y1 + 1, height); y++) {
+						const float *v = voxels + z * slice + y * row;
+						for (int x = std::max(x0 - 1, 0); x < std::min(x1 + 1, width); x++) {
+							vmin = std::min(vmin, v[x]);
+							vmax = std::max(vmax, v[x]);
+						}
+					}
+				}
+
+				/* Voxels dropped with their brick read as background. */
+				if (tolerance > 0.0f) {
+					vmin = std::min(vmin, background);
+					vmax = std::max(vmax, background);
+				}
+
+				const size_t index = brick_row * root_res_.x + bx;
+				root_[index] = active ? 1 : -1;
+				brick_range_[index] = make_float2(vmin, vmax);
+			}
+		}
+	});
+
+	/* Bricks are stored in root table order, which keeps neighbours along x
+	 * next to each other in memory. */
+	int32_t num_leaves = 0;
+	for (size_t i = 0; i < num_root; i++) {
+		max_value_ = std::max(max_value_, brick_range_[i].y);
+		if (root_[i] > 0)
+			root_[i] = num_leaves++;
+	}
+
+	leaves_.resize((size_t)num_leaves * LEAF_SIZE);
+
+	tbb::parallel_for(tbb::blocked_range<size_t>(0, num_root), [&](const tbb::blocked_range<size_t> &r) {
+		for (size_t i = r.begin(); i != r.end(); i++) {
+			if (root_[i] < 0)
+				continue;
+
+			const int bx = (int)(i % root_res_.x);
+			const int by = (int)((i / root_res_.x) % root_res_.y);
+			const int bz = (int)(i / ((size_t)root_res_.x * root_res_.y));
+			float *leaf = &leaves_[(size_t)root_[i] * LEAF_SIZE];
+
+			/* Voxels of partial bricks past the grid edge get the background. */
+			for (int lz = 0; lz < LEAF_DIM; lz++) {
+				const int z = (bz << LEAF_LOG2) + lz;
+				for (int ly = 0; ly < LEAF_DIM; ly++) {
+					const int y = (by << LEAF_LOG2) + ly;
+					for (int lx = 0; lx < LEAF_DIM; lx++) {
+						const int x = (bx << LEAF_LOG2) + lx;
+						const bool inside = x < width && y < height && z < depth;
+						leaf[leaf_offset(lx, ly, lz)] = inside ? voxels[z * slice + y * row + x] : background;
+					}
+				}
+			}
+		}
+	});
+
+	return true;
+}
+
+float VolumeGrid::sample(const float3 &P) const {
+	if (!(P.x >= 0.0f && P.y >= 0.0f && P.z >= 0.0f && P.x <= width_ && P.y <= height_ && P.z <= depth_))
+		return background_;
+
+	/* Shift to voxel centers, values are clamped at the grid boundary like
+	 * the dense smoke textures are. */
+	const float fx = clamp(P.x - 0.5f, 0.0f, (float)(width_ - 1));
+	const float fy = clamp(P.y - 0.5f, 0.0f, (float)(height_ - 1));
+	const float fz = clamp(P.z - 0.5f, 0.0f, (float)(depth_ - 1));
+
+	const int x = std::min((int)fx, width_ - 1), y = std::min((int)fy, height_ - 1), z = std::min((int)fz, depth_ - 1);
+	const float tx = fx - x, ty = fy - y, tz = fz - z;
+
+	const float c00 = lookup(x, y, z) * (1.0f - tx) + lookup(x + 1, y, z) * tx;
+	const float c10 = lookup(x, y + 1, z) * (1.0f - tx) + lookup(x + 1, y + 1, z) * tx;
+	const float c01 = lookup(x, y, z + 1) * (1.0f - tx) + lookup(x + 1, y, z + 1) * tx;
+	const float c11 = lookup(x, y + 1, z + 1) * (1.0f - tx) + lookup(x + 1, y + 1, z + 1) * tx;
+
+	return ((c00 * (1.0f - ty) + c10 * ty) * (1.0f - tz)) + ((c01 * (1.0f - ty) + c11 * ty) * tz);
+}
+
+Volume::Volume(): tfm(transform_identity()), world_to_index(transform_identity()), albedo(make_float3(0.8f)), density_scale(1.0f) {
+
+}
+
+bool Volume::update_transform() {
+	Transform inv;
+	if (!transform_inverse(tfm, &inv))
+		return false;
+
+	/* Object space unit cube to index space. */
+	const float res[3] = {(float)density.width(), (float)density.height(), (float)density.depth()};
+	float *rows[3] = {inv.x, inv.y, inv.z};
+	for (int i = 0; i < 3; i++)
+		for (int j = 0; j < 4; j++)
+			rows[i][j] *= res[i];
+
+	world_to_index = inv;
+	return true;
+}
+
+bool Volume::intersect_bounds(const float3 &P, const float3 &D, float tfar, float *t0, float *t1) const {
+	/* Slab test in index space, ray distances are the same in both spaces as
+	 * the transform is affine. */
+	const float3 O = transform_point(world_to_index, P);
+	const float3 Di = transform_direction(world_to_index, D);
+	const float res[3] = {(float)density.width(), (float)density.height(), (float)density.depth()};
+
+	float tmin = 0.0f, tmax = tfar;
+	for (int i = 0; i < 3; i++) {
+		const float inv_d = 1.0f / Di[i];
+		float ta = -O[i] * inv_d;
+		float tb = (res[i] - O[i]) * inv_d;
+		if (ta > tb)
+			std::swap(ta, tb);
+		/* NaN from a ray parallel to and on a slab plane keeps the old bounds. */
+		tmin = (ta > tmin) ? ta : tmin;
+		tmax = (tb < tmax) ? tb : tmax;
+	}
+
+	*t0 = tmin;
+	*t1 = tmax;
+	return tmin < tmax;
+}
+
+} // namespace steam
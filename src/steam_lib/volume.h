@@ -0,0 +1,177 @@
+#ifndef __STEAM_VOLUME_H__
+#define __STEAM_VOLUME_H__
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include "steam_lib/util_math.h"
+
+namespace steam {
+
+/* Sparse, read only voxel grid in the spirit of NanoVDB's leaf level.
+ *
+ * The index space is split into bricks of 8^3 voxels. Only bricks holding a
+ * voxel that differs from the background are stored, back to back in one
+ * array. A flat root table with one entry per brick of the index space holds
+ * the brick index, or -1 for empty space. A lookup is one table load and one
+ * brick load, and empty space costs 4 bytes per brick instead of 2KB.
+ *
+ * Next to the root table the grid keeps the range of values interpolated
+ * anywhere inside each brick, which includes the neighbouring voxels the
+ * trilinear filter reaches into. Volume tracking uses these as a coarse
+ * majorant grid to skip empty bricks and take exact steps through uniform
+ * ones. */
+
+class VolumeGrid {
+  public:
+	enum {
+		LEAF_LOG2 = 3,
+		LEAF_DIM = 1 << LEAF_LOG2,
+		LEAF_MASK = LEAF_DIM - 1,
+		LEAF_SIZE = LEAF_DIM * LEAF_DIM * LEAF_DIM,
+	};
+
+	VolumeGrid();
+
+	/* Build from dense voxels with x varying fastest. Voxels within tolerance
+	 * of the background don't keep a brick alive. Returns false for an empty
+	 * resolution. */
+	bool build(const float *voxels, int width, int height, int depth, float background = 0.0f, float tolerance = 0.0f);
+
+	int width() const { return width_; }
+	int height() const { return height_; }
+	int depth() const { return depth_; }
+	bool empty() const { return root_.empty(); }
+
+	float lookup(int x, int y, int z) const {
+		if ((unsigned)x >= (unsigned)width_ || (unsigned)y >= (unsigned)height_ || (unsigned)z >= (unsigned)depth_)
+			return background_;
+
+		const int32_t leaf = root_[((size_t)(z >> LEAF_LOG2) * root_res_.y + (y >> LEAF_LOG2)) * root_res_.x + (x >> LEAF_LOG2)];
+		if (leaf < 0)
+			return background_;
+
+		return leaves_[(size_t)leaf * LEAF_SIZE + leaf_offset(x & LEAF_MASK, y & LEAF_MASK, z & LEAF_MASK)];
+	}
+
+	/* Trilinear interpolation between voxel centers, at P in index space where
+	 * voxel i covers [i, i + 1). */
+	float sample(const float3 &P) const;
+
+	/* Number of bricks along each axis, and the value range of a brick. */
+	int3 brick_resolution() const { return root_res_; }
+	float2 brick_range(int x, int y, int z) const {
+		return brick_range_[((size_t)z * root_res_.y + y) * root_res_.x + x];
+	}
+
+	float background() const { return background_; }
+	/* Largest value of the grid, including the background. */
+	float max_value() const { return max_value_; }
+
+	size_t num_leaves() const { return leaves_.size() / LEAF_SIZE; }
+	size_t memory_size() const {
+		return root_.size() * sizeof(int32_t) + brick_range_.size() * sizeof(float2) + leaves_.size() * sizeof(float);
+	}
+
+  private:
+	static int leaf_offset(int x, int y, int z) { return (((z << LEAF_LOG2) | y) << LEAF_LOG2) | x; }
+
+	int width_, height_, depth_;
+	int3 root_res_;
+	float background_;
+	float max_value_;
+	std::vector<int32_t> root_;
+	std::vector<float2> brick_range_;
+	std::vector<float> leaves_;
+};
+
+/* Heterogeneous volume scattering isotropically. The density grid fills the
+ * unit cube of object space, placed in the world by tfm. */
+
+struct Volume {
+	Volume();
+
+	/* Update the world to index space transform after changing tfm or the
+	 * grid resolution, returns false for a degenerate transform. */
+	bool update_transform();
+
+	/* Clip a world space ray to the grid bounds, in ray distances. */
+	bool intersect_bounds(const float3 &P, const float3 &D, float tfar, float *t0, float *t1) const;
+
+	/* Extinction coefficient at a world space position. */
+	float extinction(const float3 &P) const {
+		return density_scale * density.sample(transform_point(world_to_index, P));
+	}
+
+	float max_extinction() const { return density_scale * density.max_value(); }
+
+	/* Walk the bricks a world space ray crosses between t0 and t1, inside the
+	 * grid bounds, calling func(ta, tb, min_extinction, max_extinction) for
+	 * each segment in order until it returns false. */
+	template<typename Func>
+	void traverse(const float3 &P, const float3 &D, float t0, float t1, const Func &func) const;
+
+	std::string name;
+	VolumeGrid density;
+	Transform tfm;
+	Transform world_to_index;
+	float3 albedo;
+	float density_scale;
+};
+
+template<typename Func>
+void Volume::traverse(const float3 &P, const float3 &D, float t0, float t1, const Func &func) const {
+	/* 3D DDA over the bricks in index space, where ray distances are the same
+	 * as in world space. */
+	const float3 O = transform_point(world_to_index, P);
+	const float3 Di = transform_direction(world_to_index, D);
+	const int3 res = density.brick_resolution();
+	const int num_cells[3] = {res.x, res.y, res.z};
+	const float inf = std::numeric_limits<float>::infinity();
+	const float3 start = O + Di * t0;
+
+	int cell[3], step[3];
+	float t_next[3], t_delta[3];
+	for (int i = 0; i < 3; i++) {
+		cell[i] = clamp((int)floorf(start[i] * (1.0f / VolumeGrid::LEAF_DIM)), 0, num_cells[i] - 1);
+		if (Di[i] > 0.0f) {
+			step[i] = 1;
+			t_next[i] = t0 + ((cell[i] + 1) * VolumeGrid::LEAF_DIM - start[i]) / Di[i];
+			t_delta[i] = VolumeGrid::LEAF_DIM / Di[i];
+		}
+		else if (Di[i] < 0.0f) {
+			step[i] = -1;
+			t_next[i] = t0 + (cell[i] * VolumeGrid::LEAF_DIM - start[i]) / Di[i];
+			t_delta[i] = -VolumeGrid::LEAF_DIM / Di[i];
+		}
+		else {
+			step[i] = 0;
+			t_next[i] = inf;
+			t_delta[i] = inf;
+		}
+	}
+
+	for (float t = t0; t < t1;) {
+		const int axis = (t_next[0] < t_next[1]) ? ((t_next[0] < t_next[2]) ? 0 : 2) : ((t_next[1] < t_next[2]) ? 1 : 2);
+		const float t_exit = std::min(t_next[axis], t1);
+
+		if (t_exit > t) {
+			const float2 range = density.brick_range(cell[0], cell[1], cell[2]);
+			if (!func(t, t_exit, density_scale * range.x, density_scale * range.y))
+				return;
+			t = t_exit;
+		}
+
+		cell[axis] += step[axis];
+		if (cell[axis] < 0 || cell[axis] >= num_cells[axis])
+			return;
+		t_next[axis] += t_delta[axis];
+	}
+}
+
+} // namespace steam
+
+#endif //__STEAM_VOLUME_H__